@@ -0,0 +1,352 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+
+/** Размер блока tar. */
+#define TAR_BLOCK            (512)
+
+/** Максимальный размер, записываемый в заголовок tar восьмеричным числом. */
+#define TAR_MAX_OCTAL        ((off_t)077777777777LL)
+
+/** Выравнивание cpio newc. */
+#define CPIO_ALIGN           (4)
+
+/** Максимальный размер файла в cpio newc. */
+#define CPIO_MAX_SIZE        ((off_t)0xffffffffLL)
+
+/** Имя завершающей записи cpio. */
+#define CPIO_TRAILER         ("TRAILER!!!")
+
+/** Размер буфера копирования. */
+#define ARCHIVE_BUFSIZE      (64 * 1024)
+
+/** Заголовок ustar. */
+struct tar_header {
+	char name[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char chksum[8];
+	char typeflag;
+	char linkname[100];
+	char magic[6];
+	char version[2];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char prefix[155];
+	char pad[12];
+};
+
+/** Выходной поток архива. */
+static FILE *archive;
+static enum archive_format format;
+static time_t mtime;
+static unsigned long ino;
+
+/** Текущий файл. */
+static char *cur_name;
+static off_t cur_size;
+static off_t cur_written;
+static mode_t cur_mode;
+/** Временный файл для данных неизвестного размера. */
+static FILE *spill;
+
+/**
+ * Функция записи в архив с проверкой.
+ */
+static int put(const void *data, size_t size) {
+	if( 0 != size && 1 != fwrite(data, size, 1, archive) )
+		return -1;
+	return 0;
+}
+
+/**
+ * Функция записи нулевых байтов.
+ */
+static int put_zeros(off_t size) {
+	static const char zeros[ TAR_BLOCK ];
+
+	while( size > 0 ) {
+		size_t n = size > (off_t)sizeof(zeros) ? sizeof(zeros) : (size_t)size;
+
+		if( 0 != put(zeros, n) )
+			return -1;
+		size -= n;
+	}
+	return 0;
+}
+
+/**
+ * Функция выравнивания данных файла размера size.
+ */
+static int put_padding(off_t size) {
+	off_t align = (ARCHIVE_TAR == format) ? TAR_BLOCK : CPIO_ALIGN;
+
+	return put_zeros((align - size % align) % align);
+}
+
+/**
+ * Процедура записи числа в восьмеричное поле заголовка tar.
+ */
+static void tar_octal(char *field, size_t size, off_t value) {
+	if( value > TAR_MAX_OCTAL && 12 == size ) {
+		/* GNU: двоичное представление для больших размеров */
+		size_t i;
+
+		for(i = size; i-- > 1; value >>= 8)
+			field[i] = (char)(value & 0xff);
+		field[0] = (char)0x80;
+	} else
+		snprintf(field, size, "%0*llo", (int)size - 1, (unsigned long long)value);
+}
+
+/**
+ * Функция записи заголовка tar.
+ */
+static int tar_put_header(const char *name, off_t size, mode_t mode, char typeflag) {
+	struct tar_header h;
+	const unsigned char *p;
+	unsigned sum = 0;
+	size_t len = strlen(name);
+	size_t i;
+
+	memset(&h, 0, sizeof(h));
+
+	if( len <= sizeof(h.name) ) {
+		memcpy(h.name, name, len);
+	} else {
+		/* делим путь_имя на prefix и name по '/' */
+		const char *s = name + len - sizeof(h.name) - 1;
+
+		while( '\0' != *s && '/' != *s )
+			++s;
+		if( '\0' == *s || (size_t)(s - name) > sizeof(h.prefix) )
+			return 1;
+		memcpy(h.prefix, name, s - name);
+		memcpy(h.name, s + 1, len - (s - name) - 1);
+	}
+
+	tar_octal(h.mode, sizeof(h.mode), mode & 07777);
+	tar_octal(h.uid, sizeof(h.uid), 0);
+	tar_octal(h.gid, sizeof(h.gid), 0);
+	tar_octal(h.size, sizeof(h.size), size);
+	tar_octal(h.mtime, sizeof(h.mtime), mtime);
+	h.typeflag = typeflag;
+	memcpy(h.magic, "ustar", 6);
+	memcpy(h.version, "00", 2);
+
+	memset(h.chksum, ' ', sizeof(h.chksum));
+	for(p = (const unsigned char*)&h, i = 0; i < sizeof(h); ++i)
+		sum += p[i];
+	snprintf(h.chksum, sizeof(h.chksum), "%06o", sum);
+
+	return put(&h, sizeof(h));
+}
+
+/**
+ * Функция записи заголовка tar; длинное путь_имя передаётся
+ * расширенным заголовком pax.
+ */
+static int tar_header(const char *name, off_t size, mode_t mode) {
+	int rc = tar_put_header(name, size, mode, '0');
+
+	if( 1 == rc ) {
+		char record[ 32 ];
+		size_t len = strlen(name) + sizeof(" path=\n") - 1;
+		size_t total = len;
+		int digits;
+
+		/* длина записи включает саму себя */
+		do {
+			digits = snprintf(record, sizeof(record), "%lu", (unsigned long)total);
+			total = len + digits;
+		} while( snprintf(record, sizeof(record), "%lu", (unsigned long)total) != digits );
+
+		if( 0 != tar_put_header("././@PaxHeader", total, 0644, 'x')
+				|| 0 != put(record, digits) || 0 != put(" path=", 6)
+				|| 0 != put(name, strlen(name)) || 0 != put("\n", 1)
+				|| 0 != put_padding(total) )
+			return -1;
+
+		/* в основном заголовке остаётся усечённое имя */
+		{
+			char short_name[ 101 ];
+
+			snprintf(short_name, sizeof(short_name), "%s", name + strlen(name) - 100);
+			rc = tar_put_header(short_name, size, mode, '0');
+		}
+	}
+
+	return rc;
+}
+
+/**
+ * Функция записи заголовка cpio newc.
+ */
+static int cpio_header(const char *name, off_t size, unsigned long mode) {
+	char h[ 111 ];
+	size_t namesize = strlen(name) + 1;
+
+	if( size > CPIO_MAX_SIZE ) {
+		errno = EFBIG;
+		return -1;
+	}
+
+	snprintf(h, sizeof(h), "070701%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X",
+		mode ? (unsigned)++ino : 0u, (unsigned)mode, 0u, 0u, mode ? 1u : 0u, (unsigned)mtime,
+		(unsigned)size, 0u, 0u, 0u, 0u, (unsigned)namesize, 0u);
+
+	if( 0 != put(h, 110) || 0 != put(name, namesize) )
+		return -1;
+
+	return put_zeros((CPIO_ALIGN - (110 + namesize) % CPIO_ALIGN) % CPIO_ALIGN);
+}
+
+/**
+ * Функция записи заголовка в текущем формате.
+ */
+static int header(const char *name, off_t size, mode_t mode) {
+	if( ARCHIVE_TAR == format )
+		return tar_header(name, size, mode);
+	return cpio_header(name, size, S_IFREG | (mode & 07777));
+}
+
+/**
+ * Функция записи данных файла известного размера (интерфейс fopencookie).
+ * Данные сверх объявленного размера не записываются.
+ */
+static ssize_t direct_write(void *cookie, const char *buf, size_t size) {
+	(void)cookie;
+
+	if( (off_t)size > cur_size - cur_written ) {
+		errno = EFBIG;
+		return -1;
+	}
+
+	if( 0 != put(buf, size) )
+		return -1;
+
+	cur_written += size;
+	return size;
+}
+
+int archive_open(enum archive_format f, const char *pathname) {
+	format = f;
+	mtime = time(NULL);
+	ino = 0;
+
+	if( NULL == pathname || 0 == strcmp(pathname, "-") ) {
+		archive = stdout;
+	} else if( NULL == (archive = fopen(pathname, "wb")) )
+		return -1;
+
+	return 0;
+}
+
+FILE *archive_begin(const char *pathname, off_t size, long mode) {
+	static const cookie_io_functions_t io = { NULL, direct_write, NULL, NULL };
+	FILE *out;
+
+	if( NULL == (cur_name = strdup(pathname)) )
+		return NULL;
+
+	cur_size = size;
+	cur_written = 0;
+	cur_mode = -1 == mode ? 0644 : (mode_t)mode;
+
+	if( -1 == size ) {
+		/* размер станет известен после распаковки */
+		if( NULL == (spill = tmpfile()) ) {
+			free(cur_name);
+			cur_name = NULL;
+		}
+		return spill;
+	}
+
+	if( 0 != header(pathname, size, cur_mode) || NULL == (out = fopencookie(NULL, "wb", io)) ) {
+		free(cur_name);
+		cur_name = NULL;
+		return NULL;
+	}
+
+	return out;
+}
+
+int archive_end(FILE *out) {
+	int rc = 0;
+
+	if( out == spill ) {
+		/* копируем накопленные данные */
+		char *buf = NULL;
+		off_t size;
+
+		if( 0 != fflush(spill) || -1 == (size = ftello(spill))
+				|| NULL == (buf = (char*)malloc(ARCHIVE_BUFSIZE)) || 0 != header(cur_name, size, cur_mode) ) {
+			rc = -1;
+		} else {
+			size_t n;
+
+			rewind(spill);
+			while( 0 != (n = fread(buf, 1, ARCHIVE_BUFSIZE, spill)) ) {
+				if( 0 != put(buf, n) ) {
+					rc = -1;
+					break;
+				}
+			}
+
+			if( ferror(spill) || 0 != put_padding(size) )
+				rc = -1;
+		}
+
+		free(buf);
+		fclose(spill);
+		spill = NULL;
+
+	} else {
+		if( 0 != fclose(out) )
+			rc = -1;
+
+		/* архив должен остаться корректным: дополняем до объявленного размера */
+		if( cur_written != cur_size )
+			rc = -1;
+		if( 0 != put_zeros(cur_size - cur_written) || 0 != put_padding(cur_size) )
+			rc = -1;
+	}
+
+	free(cur_name);
+	cur_name = NULL;
+
+	return rc;
+}
+
+int archive_close() {
+	int rc = 0;
+
+	if( ARCHIVE_TAR == format )
+		rc = put_zeros(2 * TAR_BLOCK);
+	else
+		rc = cpio_header(CPIO_TRAILER, 0, 0);
+
+	if( 0 != fflush(archive) || ferror(archive) )
+		rc = -1;
+
+	if( stdout != archive && 0 != fclose(archive) )
+		rc = -1;
+
+	archive = NULL;
+	return rc;
+}
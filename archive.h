@@ -0,0 +1,56 @@
+#ifndef __archive_h__
+#define __archive_h__
+
+#ifdef __cplusplus
+#include <cstdio>
+#else
+#include <stdio.h>
+#endif
+
+#include <sys/types.h>
+
+/** Форматы выходного архива. */
+enum archive_format {ARCHIVE_NONE, ARCHIVE_TAR, ARCHIVE_CPIO};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	/**
+	 * Функция открытия выходного архива.
+	 * @param format формат архива (ustar или cpio newc)
+	 * @param pathname путь_имя архива; NULL или "-" -- стандартный вывод
+	 * @return 0 -- успешно; -1 -- ошибка (errno)
+	 */
+	int archive_open(enum archive_format format, const char *pathname);
+
+	/**
+	 * Функция начала записи файла в архив.
+	 * Если размер известен, заголовок пишется сразу и данные идут прямо в
+	 * архив; иначе данные накапливаются во временном файле.
+	 * @param pathname путь_имя файла в архиве
+	 * @param size размер файла; -1 -- неизвестен
+	 * @param mode права доступа (заголовок begin-base64); -1 -- 0644
+	 * @return поток для записи содержимого файла; NULL -- ошибка
+	 */
+	FILE *archive_begin(const char *pathname, off_t size, long mode);
+
+	/**
+	 * Функция завершения записи файла в архив.
+	 * Поток, полученный от archive_begin(), закрывается. Если записано
+	 * не столько байт, сколько было объявлено, содержимое дополняется
+	 * нулями (архив остаётся корректным) и возвращается ошибка.
+	 * @return 0 -- успешно; -1 -- ошибка записи или несовпадение размера
+	 */
+	int archive_end(FILE *out);
+
+	/**
+	 * Функция записи завершающих блоков и закрытия архива.
+	 * @return 0 -- успешно; -1 -- ошибка записи
+	 */
+	int archive_close();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__archive_h__*/
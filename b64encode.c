@@ -7,6 +7,31 @@
 #include <sys/types.h>
 
 #include "base64.h"
+#include "crc.h"
+#include "delta.h"
+
+/** Блок индекса записи (-s): 1456 строк по 45 байт входа, около 64 КиБ. */
+#define INDEX_BLOCK_LINES    (1456)
+#define INDEX_BLOCK          (45 * INDEX_BLOCK_LINES)
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+/** Число строк (по 45 байт входа) в одном задании параллельного кодирования. */
+#define ENCODE_CHUNK_LINES   (16 * 1024)
+
+/** Размер входных данных одного задания; кратен 45, границы строк не меняются. */
+#define ENCODE_CHUNK         (45 * ENCODE_CHUNK_LINES)
+
+/** Число буферов очереди закодированных данных. */
+#define ENCODE_SLOTS         (16)
+
+/** Предельное число потоков кодирования. */
+#define ENCODE_MAX_THREADS   (16)
+#endif /* _WIN32 */
 
 #ifdef _MSC_VER
 typedef int mode_t;
@@ -17,16 +42,303 @@ const size_t nl_len = sizeof("\n") - 1;
 
 const char *argv_0;
 
-void encode(const char *name, const mode_t mode, FILE *in, FILE *out) {
+/** Выводить запись в формате extrac4 (<++> имя !base64 !size=n ... <-->). */
+int tag_format = 0;
+
+/** Кодирование записи: стандартный base64 либо URL-safe без выравнивания (-u). */
+size_t (*encoder)(const char *in, size_t inlen, char *out, size_t outlen) = base64_encode;
+const char *encoding = "!base64";
+
+/** Дописывать к записи индекс блоков для чтения диапазонов (!index). */
+int seekable = 0;
+
+/** ПутьИмя базы разностной записи (!delta); NULL -- запись целиком. */
+const char *delta_base = NULL;
+/** Контрольная сумма базы. */
+u_int32_t delta_crc;
+
+/**
+ * Функция вывода путь_имени в заголовок записи extrac4:
+ * пробелы, табуляции и '\\' экранируются.
+ */
+int put_name(const char *name, FILE *out) {
+	for(; '\0' != *name; ++name) {
+		if( (' ' == *name || '\t' == *name || '\\' == *name) && EOF == fputc('\\', out) )
+			return -1;
+		if( EOF == fputc(*name, out) )
+			return -1;
+	}
+	return 0;
+}
+
+#ifndef _WIN32
+/** Буфер очереди закодированных данных. */
+struct encode_slot {
+	int ready;
+	char *data;
+	size_t len;
+};
+
+/** Состояние параллельного кодирования отображённого в память файла. */
+struct encoder {
+	const char *src;
+	size_t src_len;
+	size_t nchunks;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	size_t next;
+	size_t written;
+	int stop;
+
+	struct encode_slot slots[ ENCODE_SLOTS ];
+};
+
+/**
+ * Функция кодирования задания: те же строки по 45 байт, что и в encode().
+ * @return длина закодированных данных
+ */
+size_t encode_chunk(const char *src, size_t len, char *dst) {
+	char *d = dst;
+
+	while( len > 0 ) {
+		size_t n = len < 45 ? len : 45;
+
+		d += encoder(src, n, d, base64_length(n));
+		memcpy(d, nl, nl_len);
+		d += nl_len;
+		src += n;
+		len -= n;
+	}
+
+	return d - dst;
+}
+
+/**
+ * Поток кодирования: забирает очередное задание и кладёт результат в очередь.
+ */
+void *encode_worker(void *arg) {
+	struct encoder *e = (struct encoder*)arg;
+
+	pthread_mutex_lock(&e->lock);
+
+	while( !e->stop && e->next < e->nchunks ) {
+		struct encode_slot *slot;
+		size_t index;
+		size_t off;
+
+		/* ждём освобождения буфера */
+		if( e->next >= e->written + ENCODE_SLOTS ) {
+			pthread_cond_wait(&e->cond, &e->lock);
+			continue;
+		}
+
+		index = e->next++;
+		slot = &e->slots[ index % ENCODE_SLOTS ];
+		off = index * ENCODE_CHUNK;
+
+		pthread_mutex_unlock(&e->lock);
+		slot->len = encode_chunk(e->src + off,
+			e->src_len - off < ENCODE_CHUNK ? e->src_len - off : ENCODE_CHUNK, slot->data);
+		pthread_mutex_lock(&e->lock);
+
+		slot->ready = 1;
+		pthread_cond_broadcast(&e->cond);
+	}
+
+	pthread_mutex_unlock(&e->lock);
+	return NULL;
+}
+
+/**
+ * Функция записи всего вектора с учётом частичной записи.
+ */
+int writev_all(int fd, struct iovec *iov, int iovcnt) {
+	while( iovcnt > 0 ) {
+		ssize_t rec = writev(fd, iov, iovcnt);
+
+		if( -1 == rec ) {
+			if( EINTR == errno )
+				continue;
+			return -1;
+		}
+
+		while( iovcnt > 0 && (size_t)rec >= iov->iov_len ) {
+			rec -= iov->iov_len;
+			++iov;
+			--iovcnt;
+		}
+		if( iovcnt > 0 ) {
+			iov->iov_base = (char*)iov->iov_base + rec;
+			iov->iov_len -= rec;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Функция параллельного кодирования обычного файла через mmap.
+ * Закодированные задания выводятся по порядку, группами через writev().
+ * @return 1 -- файл закодирован; 0 -- файл мал или не отображается
+ *         (кодировать последовательно); -1 -- ошибка (errno)
+ */
+int encode_mapped(FILE *in, FILE *out) {
+	struct encoder e;
+	pthread_t threads[ ENCODE_MAX_THREADS ];
+	long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	struct stat status;
+	void *map;
+	int rc = 1;
+	int i;
+
+	if( -1 == fstat(fileno(in), &status) || !S_ISREG(status.st_mode)
+			|| status.st_size < 2 * ENCODE_CHUNK || (off_t)(size_t)status.st_size != status.st_size )
+		return 0;
+
+	if( MAP_FAILED == (map = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fileno(in), 0)) )
+		return 0;
+	madvise(map, status.st_size, MADV_SEQUENTIAL);
+
+	memset(&e, 0, sizeof(e));
+	e.src = (const char*)map;
+	e.src_len = status.st_size;
+	e.nchunks = (e.src_len + ENCODE_CHUNK - 1) / ENCODE_CHUNK;
+
+	for(i = 0; i < ENCODE_SLOTS; ++i) {
+		if( NULL == (e.slots[i].data = (char*)malloc(ENCODE_CHUNK_LINES * (base64_length(45) + nl_len))) ) {
+			rc = -1;
+			goto _free;
+		}
+	}
+
+	/* заголовок уже в буфере потока */
+	if( 0 != fflush(out) ) {
+		rc = -1;
+		goto _free;
+	}
+
+	if( nthreads < 1 )
+		nthreads = 1;
+	if( nthreads > ENCODE_MAX_THREADS )
+		nthreads = ENCODE_MAX_THREADS;
+
+	pthread_mutex_init(&e.lock, NULL);
+	pthread_cond_init(&e.cond, NULL);
+
+	for(i = 0; i < nthreads; ++i)
+		if( 0 != pthread_create(&threads[i], NULL, encode_worker, &e) )
+			break;
+	nthreads = i;
+
+	/* потоки не запустились: кодируем последовательно */
+	if( 0 == nthreads )
+		rc = 0;
+
+	while( 0 != nthreads && e.written < e.nchunks ) {
+		struct iovec iov[ ENCODE_SLOTS ];
+		int n = 0;
+
+		/* ждём очередное задание и забираем все готовые следом за ним */
+		pthread_mutex_lock(&e.lock);
+		while( !e.slots[ e.written % ENCODE_SLOTS ].ready )
+			pthread_cond_wait(&e.cond, &e.lock);
+		while( n < ENCODE_SLOTS && e.written + n < e.nchunks && e.slots[ (e.written + n) % ENCODE_SLOTS ].ready ) {
+			struct encode_slot *slot = &e.slots[ (e.written + n) % ENCODE_SLOTS ];
+
+			iov[n].iov_base = slot->data;
+			iov[n].iov_len = slot->len;
+			++n;
+		}
+		pthread_mutex_unlock(&e.lock);
+
+		if( 0 != writev_all(fileno(out), iov, n) ) {
+			rc = -1;
+			break;
+		}
+
+		pthread_mutex_lock(&e.lock);
+		for(i = 0; i < n; ++i)
+			e.slots[ (e.written + i) % ENCODE_SLOTS ].ready = 0;
+		e.written += n;
+		pthread_cond_broadcast(&e.cond);
+		pthread_mutex_unlock(&e.lock);
+	}
+
+	pthread_mutex_lock(&e.lock);
+	e.stop = 1;
+	pthread_cond_broadcast(&e.cond);
+	pthread_mutex_unlock(&e.lock);
+
+	for(i = 0; i < nthreads; ++i)
+		pthread_join(threads[i], NULL);
+
+	pthread_cond_destroy(&e.cond);
+	pthread_mutex_destroy(&e.lock);
+
+ _free:
+	for(i = 0; i < ENCODE_SLOTS; ++i)
+		free(e.slots[i].data);
+	munmap(map, status.st_size);
+
+	return rc;
+}
+#endif /* _WIN32 */
+
+/**
+ * Функция расчёта длины закодированных данных записи: строки по 45 байт
+ * входа и перевод строки после каждой.
+ */
+off_t encoded_length(off_t size) {
+	size_t rest = size % 45;
+	off_t len = size / 45 * (off_t)(base64_length(45) + nl_len);
+
+	if( 0 != rest )
+		len += (base64_encode == encoder ? base64_length(rest) : rest / 3 * 4 + (rest % 3 ? rest % 3 + 1 : 0)) + nl_len;
+	return len;
+}
+
+/**
+ * Функция вывода таблицы индекса: для каждого блока -- смещение его первой
+ * строки от начала данных записи (строки фиксированной длины "!%012llx").
+ */
+int put_index(off_t size, FILE *out) {
+	off_t k;
+
+	for(k = 0; k * INDEX_BLOCK < size; ++k) {
+		if( 0 > fprintf(out, "!%012llx%s", (unsigned long long)(k * INDEX_BLOCK_LINES * (off_t)(base64_length(45) + nl_len)), nl) )
+			return -1;
+	}
+	return 0;
+}
+
+void encode(const char *name, const mode_t mode, off_t size, FILE *in, FILE *out) {
 	char in_buf[ 45 ];
 	char out_buf[ base64_length(45) ];
-	size_t rec;
+	size_t rec = 0;
+	int mapped = 0;
 
-	if( 0 > fprintf(out, "%s %o %s\n", "begin-base64", mode, name) )
+	if( tag_format ) {
+		if( 0 > fprintf(out, "%s ", "<++>") || 0 != put_name(name, out) || 0 > fprintf(out, " %s", encoding) )
+			goto _fail_io;
+		/* размер известен только для обычных файлов */
+		if( -1 != size && 0 > fprintf(out, " !size=%lld", (long long)size) )
+			goto _fail_io;
+		if( NULL != delta_base && 0 > fprintf(out, " !delta=%08x", (unsigned)delta_crc) )
+			goto _fail_io;
+		if( seekable && 0 > fprintf(out, " !index=%d@%lld", INDEX_BLOCK, (long long)encoded_length(size)) )
+			goto _fail_io;
+		if( 1 != fwrite(nl, nl_len, 1, out) )
+			goto _fail_io;
+	} else if( 0 > fprintf(out, "%s %o %s\n", "begin-base64", mode, name) )
+		goto _fail_io;
+#ifndef _WIN32
+	if( -1 == (mapped = encode_mapped(in, out)) )
 		goto _fail_io;
-	while( sizeof(in_buf) == (rec = fread(in_buf, 1, sizeof(in_buf), in)) ) {
+#endif
 
-		base64_encode(in_buf, sizeof(in_buf), out_buf, sizeof(out_buf));
+	while( !mapped && sizeof(in_buf) == (rec = fread(in_buf, 1, sizeof(in_buf), in)) ) {
+
+		encoder(in_buf, sizeof(in_buf), out_buf, sizeof(out_buf));
 
 		if( 1 != fwrite(out_buf, sizeof(out_buf), 1, out) )
 			goto _fail_io;
@@ -35,8 +347,8 @@ void encode(const char *name, const mode_t mode, FILE *in, FILE *out) {
 			goto _fail_io;
 	}
 
-	if( rec > 0 ) {
-		rec = base64_encode(in_buf, rec, out_buf, sizeof(out_buf));
+	if( !mapped && rec > 0 ) {
+		rec = encoder(in_buf, rec, out_buf, sizeof(out_buf));
 
 		if( 1 != fwrite(out_buf, rec, 1, out) )
 			goto _fail_io;
@@ -48,7 +360,10 @@ void encode(const char *name, const mode_t mode, FILE *in, FILE *out) {
 	if( ferror(in) )
 		goto _fail_io;
 
-	if( 1 != fwrite("====", 4, 1, out) )
+	if( seekable && 0 != put_index(size, out) )
+		goto _fail_io;
+
+	if( 1 != fwrite(tag_format ? "<-->" : "====", 4, 1, out) )
 		goto _fail_io;
 
 	if( 1 != fwrite(nl, nl_len, 1, out) )
@@ -62,8 +377,84 @@ void encode(const char *name, const mode_t mode, FILE *in, FILE *out) {
 
 }
 
+/**
+ * Функция чтения файла целиком в память.
+ * @return данные; NULL -- ошибка (errno)
+ */
+char *read_all(FILE *in, size_t *len) {
+	char *data = NULL;
+	size_t size = 0;
+	size_t rec;
+
+	*len = 0;
+	do {
+		char *p;
+
+		if( *len == size ) {
+			size = size ? 2 * size : 1024 * 1024;
+			if( NULL == (p = (char*)realloc(data, size)) ) {
+				free(data);
+				return NULL;
+			}
+			data = p;
+		}
+		rec = fread(data + *len, 1, size - *len, in);
+		*len += rec;
+	} while( 0 != rec );
+
+	if( ferror(in) ) {
+		free(data);
+		return NULL;
+	}
+	return data;
+}
+
+/**
+ * Процедура кодирования разностной записи INFILE относительно delta_base.
+ */
+void encode_delta(const char *name, const mode_t mode, FILE *in, FILE *out) {
+	FILE *base;
+	FILE *diff;
+	char *base_data;
+	char *data;
+	size_t base_len;
+	size_t len;
+
+	if( NULL == (base = fopen(delta_base, "rb")) ) {
+		fprintf(stderr, "%s: open for read \"%s\": %s\n", argv_0, delta_base, strerror(errno));
+		exit(-1);
+	}
+
+	if( NULL == (base_data = read_all(base, &base_len)) || NULL == (data = read_all(in, &len)) )
+		goto _fail_io;
+	fclose(base);
+
+	crc_gen();
+	delta_crc = crc_calc_array(0, base_data, base_len);
+
+	/* разностные данные кодируются так же, как обычный файл */
+	if( NULL == (diff = tmpfile()) || 0 != delta_diff(base_data, base_len, data, len, diff) || 0 != fflush(diff) )
+		goto _fail_io;
+	rewind(diff);
+
+	free(base_data);
+	free(data);
+
+	encode(name, mode, len, diff, out);
+	fclose(diff);
+	return;
+
+ _fail_io:
+	fprintf(stderr, "%s: %s\n", argv_0, strerror(errno));
+	exit(-1);
+}
+
 void usage() {
-	fprintf(stderr, "%s%s%s", "Usage: ", argv_0, " INFILE [ OUTFILE ]\n");
+	fprintf(stderr, "%s%s%s", "Usage: ", argv_0, " [ -t ] [ -u ] [ -s ] [ -d BASEFILE ] INFILE [ OUTFILE ]\n");
+	fprintf(stderr, "%s", "\t-t\twrite extrac4 record (<++> INFILE !base64 !size=N ... <-->)\n");
+	fprintf(stderr, "%s", "\t-u\twrite extrac4 record in unpadded URL-safe base64 (!base64url)\n");
+	fprintf(stderr, "%s", "\t-s\tadd a block index for byte-range reads (!index=BLOCK@OFFSET)\n");
+	fprintf(stderr, "%s", "\t-d\twrite extrac4 delta record against BASEFILE (!delta=CRC32)\n");
 	fprintf(stderr, "%s", "\t\t( INFILE != OUTFILE ) must be there!\n\n");
 	fprintf(stderr, "%s", "Bugs and Your Ideas mailto the.zett@gmail.com\n");
 	exit(-1);
@@ -76,6 +467,27 @@ int main(int argc, const char **argv) {
 
 	argv_0 = argv[0];
 
+	while( argc > 1 ) {
+		if( 0 == strcmp(argv[1], "-t") ) {
+			tag_format = 1;
+		} else if( 0 == strcmp(argv[1], "-s") ) {
+			tag_format = 1;
+			seekable = 1;
+		} else if( 0 == strcmp(argv[1], "-u") ) {
+			tag_format = 1;
+			encoder = base64url_encode;
+			encoding = "!base64url";
+		} else if( 0 == strcmp(argv[1], "-d") && argc > 2 ) {
+			tag_format = 1;
+			delta_base = argv[2];
+			--argc;
+			++argv;
+		} else
+			break;
+		--argc;
+		++argv;
+	}
+
 	if( 2 != argc && 3 != argc )
 		usage();
 
@@ -94,7 +506,16 @@ int main(int argc, const char **argv) {
 		return -1;
 	}
 
-	encode(argv[1], status.st_mode & 0777, in, out);
+	/* индекс строится по известному заранее размеру */
+	if( seekable && (NULL != delta_base || !S_ISREG(status.st_mode)) ) {
+		fprintf(stderr, "%s: \"%s\": %s\n", argv_0, argv[1], "block index needs a regular file and no -d");
+		return -1;
+	}
+
+	if( NULL != delta_base )
+		encode_delta(argv[1], status.st_mode & 0777, in, out);
+	else
+		encode(argv[1], status.st_mode & 0777, S_ISREG(status.st_mode) ? status.st_size : -1, in, out);
 
 	return 0;
 }
@@ -61,58 +61,66 @@ static unsigned char to_uchar(char ch) {
 	return ch;
 }
 
-/* Base64 encode IN array of size INLEN into OUT array of size OUTLEN.
-   If OUTLEN is less than BASE64_LENGTH(INLEN), write as many bytes as
-   possible. */
-size_t base64_encode(const char * in, size_t insize, char * out, size_t outsize) {
-	static const char b64str[ 65 ] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
+/* Encoding alphabets (RFC 4648, sections 4 and 5). */
+static const char b64str[ 65 ] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char b64urlstr[ 65 ] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+/* Encoder body shared by the alphabet variants.  ALPHABET and PAD are
+   constants in every caller, so each wrapper below is a specialization
+   with the table address folded in and no padding test when PAD is
+   false.  */
+static inline size_t encode_alphabet(const char * in, size_t insize, char * out, size_t outsize,
+		const char * const alphabet, const bool pad) {
 	const char * inmax = in + insize;
 	const char * outmin = out;
 	const char * outmax = out + outsize;
 
 	while( in + 3 <= inmax && out + 4 <= outmax ) {
-		*out++ = b64str[ to_uchar(in[0]) >> 2 ];
-		*out++ = b64str[ ( ( to_uchar(in[0] ) << 4 ) | ( to_uchar(in[1]) >> 4 ) ) & 0x3f ];
-		*out++ = b64str[ ( ( to_uchar(in[1]) << 2 ) | ( to_uchar(in[2]) >> 6 ) ) & 0x3f ];
-		*out++ = b64str[ to_uchar(in[2]) & 0x3f ];
+		*out++ = alphabet[ to_uchar(in[0]) >> 2 ];
+		*out++ = alphabet[ ( ( to_uchar(in[0] ) << 4 ) | ( to_uchar(in[1]) >> 4 ) ) & 0x3f ];
+		*out++ = alphabet[ ( ( to_uchar(in[1]) << 2 ) | ( to_uchar(in[2]) >> 6 ) ) & 0x3f ];
+		*out++ = alphabet[ to_uchar(in[2]) & 0x3f ];
 		in += 3;
 	}
 
 	while( in < inmax && out < outmax ) {
 
-		*out++ = b64str[ to_uchar(in[0]) >> 2 ];
+		*out++ = alphabet[ to_uchar(in[0]) >> 2 ];
 
 		if( outmax == out )
 			break;
 
 		if( inmax == in + 1 )
-			*out++ = b64str[ ( to_uchar(in[0] ) << 4) & 0x3f ];
+			*out++ = alphabet[ ( to_uchar(in[0] ) << 4) & 0x3f ];
 		else
-			*out++ = b64str[ ( ( to_uchar(in[0] ) << 4 ) | ( to_uchar(in[1]) >> 4 ) ) & 0x3f ];
+			*out++ = alphabet[ ( ( to_uchar(in[0] ) << 4 ) | ( to_uchar(in[1]) >> 4 ) ) & 0x3f ];
 
 		++in;
 
 		if( outmax == out )
 			break;
 
-		if( inmax == in )
+		if( inmax == in ) {
+			if( !pad )
+				break;
 			*out++ = '=';
-		else {
+		} else {
 			if( inmax == in + 1 )
-				*out++ = b64str[ ( to_uchar(in[0]) << 2 ) & 0x3f ];
+				*out++ = alphabet[ ( to_uchar(in[0]) << 2 ) & 0x3f ];
 			else
-				*out++ = b64str[ ( ( to_uchar(in[0]) << 2 ) | ( to_uchar(in[1]) >> 6 ) ) & 0x3f ];
+				*out++ = alphabet[ ( ( to_uchar(in[0]) << 2 ) | ( to_uchar(in[1]) >> 6 ) ) & 0x3f ];
 			++in;
 		}
 
 		if( outmax == out )
 			break;
 
-		if( inmax == in )
+		if( inmax == in ) {
+			if( !pad )
+				break;
 			*out++ = '=';
-		else {
-			*out++ = b64str[ to_uchar(in[0]) & 0x3f ];
+		} else {
+			*out++ = alphabet[ to_uchar(in[0]) & 0x3f ];
 			++in;
 		}
 	}
@@ -120,6 +128,19 @@ size_t base64_encode(const char * in, size_t insize, char * out, size_t outsize)
 	return out - outmin;
 }
 
+/* Base64 encode IN array of size INLEN into OUT array of size OUTLEN.
+   If OUTLEN is less than BASE64_LENGTH(INLEN), write as many bytes as
+   possible. */
+size_t base64_encode(const char * in, size_t insize, char * out, size_t outsize) {
+	return encode_alphabet(in, insize, out, outsize, b64str, true);
+}
+
+/* The same with the URL and filename safe alphabet and without '='
+   padding, so BASE64_LENGTH(INLEN) is always enough for OUTLEN. */
+size_t base64url_encode(const char * in, size_t insize, char * out, size_t outsize) {
+	return encode_alphabet(in, insize, out, outsize, b64urlstr, false);
+}
+
 /* Allocate a buffer and store zero terminated base64 encoded data
    from array IN of size INLEN, returning BASE64_LENGTH(INLEN), i.e.,
    the length of the encoded data, excluding the terminating zero.  On
@@ -166,8 +187,9 @@ size_t base64_encode_alloc(const char *in, size_t inlen, char **out) {
    potential problem on non-POSIX C99 platforms.
 
    IBM C V6 for AIX mishandles "#define B64(x) ...'x'...", so use "_"
-   as the formal parameter rather than "x".  */
-#define B64(_)			\
+   as the formal parameter rather than "x".  The alphabets differ only
+   in the last two characters, C62 and C63.  */
+#define B64(_, c62, c63)	\
     ((_) == 'A' ? 0		\
    : (_) == 'B' ? 1		\
    : (_) == 'C' ? 2		\
@@ -230,44 +252,48 @@ size_t base64_encode_alloc(const char *in, size_t inlen, char **out) {
    : (_) == '7' ? 59		\
    : (_) == '8' ? 60		\
    : (_) == '9' ? 61		\
-   : (_) == '+' ? 62		\
-   : (_) == '/' ? 63		\
+   : (_) == (c62) ? 62		\
+   : (_) == (c63) ? 63		\
    : -1)
 
-static const signed char b64[0x100] = {
-	B64(0x00), B64(0x01), B64(0x02), B64(0x03), B64(0x04), B64(0x05), B64(0x06), B64(0x07),
-	B64(0x08), B64(0x09), B64(0x0a), B64(0x0b), B64(0x0c), B64(0x0d), B64(0x0e), B64(0x0f),
-	B64(0x10), B64(0x11), B64(0x12), B64(0x13), B64(0x14), B64(0x15), B64(0x16), B64(0x17),
-	B64(0x18), B64(0x19), B64(0x1a), B64(0x1b), B64(0x1c), B64(0x1d), B64(0x1e), B64(0x1f),
-	B64(0x20), B64(0x21), B64(0x22), B64(0x23), B64(0x24), B64(0x25), B64(0x26), B64(0x27),
-	B64(0x28), B64(0x29), B64(0x2a), B64(0x2b), B64(0x2c), B64(0x2d), B64(0x2e), B64(0x2f),
-	B64(0x30), B64(0x31), B64(0x32), B64(0x33), B64(0x34), B64(0x35), B64(0x36), B64(0x37),
-	B64(0x38), B64(0x39), B64(0x3a), B64(0x3b), B64(0x3c), B64(0x3d), B64(0x3e), B64(0x3f),
-	B64(0x40), B64(0x41), B64(0x42), B64(0x43), B64(0x44), B64(0x45), B64(0x46), B64(0x47),
-	B64(0x48), B64(0x49), B64(0x4a), B64(0x4b), B64(0x4c), B64(0x4d), B64(0x4e), B64(0x4f),
-	B64(0x50), B64(0x51), B64(0x52), B64(0x53), B64(0x54), B64(0x55), B64(0x56), B64(0x57),
-	B64(0x58), B64(0x59), B64(0x5a), B64(0x5b), B64(0x5c), B64(0x5d), B64(0x5e), B64(0x5f),
-	B64(0x60), B64(0x61), B64(0x62), B64(0x63), B64(0x64), B64(0x65), B64(0x66), B64(0x67),
-	B64(0x68), B64(0x69), B64(0x6a), B64(0x6b), B64(0x6c), B64(0x6d), B64(0x6e), B64(0x6f),
-	B64(0x70), B64(0x71), B64(0x72), B64(0x73), B64(0x74), B64(0x75), B64(0x76), B64(0x77),
-	B64(0x78), B64(0x79), B64(0x7a), B64(0x7b), B64(0x7c), B64(0x7d), B64(0x7e), B64(0x7f),
-	B64(0x80), B64(0x81), B64(0x82), B64(0x83), B64(0x84), B64(0x85), B64(0x86), B64(0x87),
-	B64(0x88), B64(0x89), B64(0x8a), B64(0x8b), B64(0x8c), B64(0x8d), B64(0x8e), B64(0x8f),
-	B64(0x90), B64(0x91), B64(0x92), B64(0x93), B64(0x94), B64(0x95), B64(0x96), B64(0x97),
-	B64(0x98), B64(0x99), B64(0x9a), B64(0x9b), B64(0x9c), B64(0x9d), B64(0x9e), B64(0x9f),
-	B64(0xa0), B64(0xa1), B64(0xa2), B64(0xa3), B64(0xa4), B64(0xa5), B64(0xa6), B64(0xa7),
-	B64(0xa8), B64(0xa9), B64(0xaa), B64(0xab), B64(0xac), B64(0xad), B64(0xae), B64(0xaf),
-	B64(0xb0), B64(0xb1), B64(0xb2), B64(0xb3), B64(0xb4), B64(0xb5), B64(0xb6), B64(0xb7),
-	B64(0xb8), B64(0xb9), B64(0xba), B64(0xbb), B64(0xbc), B64(0xbd), B64(0xbe), B64(0xbf),
-	B64(0xc0), B64(0xc1), B64(0xc2), B64(0xc3), B64(0xc4), B64(0xc5), B64(0xc6), B64(0xc7),
-	B64(0xc8), B64(0xc9), B64(0xca), B64(0xcb), B64(0xcc), B64(0xcd), B64(0xce), B64(0xcf),
-	B64(0xd0), B64(0xd1), B64(0xd2), B64(0xd3), B64(0xd4), B64(0xd5), B64(0xd6), B64(0xd7),
-	B64(0xd8), B64(0xd9), B64(0xda), B64(0xdb), B64(0xdc), B64(0xdd), B64(0xde), B64(0xdf),
-	B64(0xe0), B64(0xe1), B64(0xe2), B64(0xe3), B64(0xe4), B64(0xe5), B64(0xe6), B64(0xe7),
-	B64(0xe8), B64(0xe9), B64(0xea), B64(0xeb), B64(0xec), B64(0xed), B64(0xee), B64(0xef),
-	B64(0xf0), B64(0xf1), B64(0xf2), B64(0xf3), B64(0xf4), B64(0xf5), B64(0xf6), B64(0xf7),
-	B64(0xf8), B64(0xf9), B64(0xfa), B64(0xfb), B64(0xfc), B64(0xfd), B64(0xfe), B64(0xff)
-};
+/* Decoding table of the alphabet, expanded at compile time. */
+#define B64_TABLE(c62, c63) \
+	B64(0x00, c62, c63), B64(0x01, c62, c63), B64(0x02, c62, c63), B64(0x03, c62, c63), B64(0x04, c62, c63), B64(0x05, c62, c63), B64(0x06, c62, c63), B64(0x07, c62, c63), \
+	B64(0x08, c62, c63), B64(0x09, c62, c63), B64(0x0a, c62, c63), B64(0x0b, c62, c63), B64(0x0c, c62, c63), B64(0x0d, c62, c63), B64(0x0e, c62, c63), B64(0x0f, c62, c63), \
+	B64(0x10, c62, c63), B64(0x11, c62, c63), B64(0x12, c62, c63), B64(0x13, c62, c63), B64(0x14, c62, c63), B64(0x15, c62, c63), B64(0x16, c62, c63), B64(0x17, c62, c63), \
+	B64(0x18, c62, c63), B64(0x19, c62, c63), B64(0x1a, c62, c63), B64(0x1b, c62, c63), B64(0x1c, c62, c63), B64(0x1d, c62, c63), B64(0x1e, c62, c63), B64(0x1f, c62, c63), \
+	B64(0x20, c62, c63), B64(0x21, c62, c63), B64(0x22, c62, c63), B64(0x23, c62, c63), B64(0x24, c62, c63), B64(0x25, c62, c63), B64(0x26, c62, c63), B64(0x27, c62, c63), \
+	B64(0x28, c62, c63), B64(0x29, c62, c63), B64(0x2a, c62, c63), B64(0x2b, c62, c63), B64(0x2c, c62, c63), B64(0x2d, c62, c63), B64(0x2e, c62, c63), B64(0x2f, c62, c63), \
+	B64(0x30, c62, c63), B64(0x31, c62, c63), B64(0x32, c62, c63), B64(0x33, c62, c63), B64(0x34, c62, c63), B64(0x35, c62, c63), B64(0x36, c62, c63), B64(0x37, c62, c63), \
+	B64(0x38, c62, c63), B64(0x39, c62, c63), B64(0x3a, c62, c63), B64(0x3b, c62, c63), B64(0x3c, c62, c63), B64(0x3d, c62, c63), B64(0x3e, c62, c63), B64(0x3f, c62, c63), \
+	B64(0x40, c62, c63), B64(0x41, c62, c63), B64(0x42, c62, c63), B64(0x43, c62, c63), B64(0x44, c62, c63), B64(0x45, c62, c63), B64(0x46, c62, c63), B64(0x47, c62, c63), \
+	B64(0x48, c62, c63), B64(0x49, c62, c63), B64(0x4a, c62, c63), B64(0x4b, c62, c63), B64(0x4c, c62, c63), B64(0x4d, c62, c63), B64(0x4e, c62, c63), B64(0x4f, c62, c63), \
+	B64(0x50, c62, c63), B64(0x51, c62, c63), B64(0x52, c62, c63), B64(0x53, c62, c63), B64(0x54, c62, c63), B64(0x55, c62, c63), B64(0x56, c62, c63), B64(0x57, c62, c63), \
+	B64(0x58, c62, c63), B64(0x59, c62, c63), B64(0x5a, c62, c63), B64(0x5b, c62, c63), B64(0x5c, c62, c63), B64(0x5d, c62, c63), B64(0x5e, c62, c63), B64(0x5f, c62, c63), \
+	B64(0x60, c62, c63), B64(0x61, c62, c63), B64(0x62, c62, c63), B64(0x63, c62, c63), B64(0x64, c62, c63), B64(0x65, c62, c63), B64(0x66, c62, c63), B64(0x67, c62, c63), \
+	B64(0x68, c62, c63), B64(0x69, c62, c63), B64(0x6a, c62, c63), B64(0x6b, c62, c63), B64(0x6c, c62, c63), B64(0x6d, c62, c63), B64(0x6e, c62, c63), B64(0x6f, c62, c63), \
+	B64(0x70, c62, c63), B64(0x71, c62, c63), B64(0x72, c62, c63), B64(0x73, c62, c63), B64(0x74, c62, c63), B64(0x75, c62, c63), B64(0x76, c62, c63), B64(0x77, c62, c63), \
+	B64(0x78, c62, c63), B64(0x79, c62, c63), B64(0x7a, c62, c63), B64(0x7b, c62, c63), B64(0x7c, c62, c63), B64(0x7d, c62, c63), B64(0x7e, c62, c63), B64(0x7f, c62, c63), \
+	B64(0x80, c62, c63), B64(0x81, c62, c63), B64(0x82, c62, c63), B64(0x83, c62, c63), B64(0x84, c62, c63), B64(0x85, c62, c63), B64(0x86, c62, c63), B64(0x87, c62, c63), \
+	B64(0x88, c62, c63), B64(0x89, c62, c63), B64(0x8a, c62, c63), B64(0x8b, c62, c63), B64(0x8c, c62, c63), B64(0x8d, c62, c63), B64(0x8e, c62, c63), B64(0x8f, c62, c63), \
+	B64(0x90, c62, c63), B64(0x91, c62, c63), B64(0x92, c62, c63), B64(0x93, c62, c63), B64(0x94, c62, c63), B64(0x95, c62, c63), B64(0x96, c62, c63), B64(0x97, c62, c63), \
+	B64(0x98, c62, c63), B64(0x99, c62, c63), B64(0x9a, c62, c63), B64(0x9b, c62, c63), B64(0x9c, c62, c63), B64(0x9d, c62, c63), B64(0x9e, c62, c63), B64(0x9f, c62, c63), \
+	B64(0xa0, c62, c63), B64(0xa1, c62, c63), B64(0xa2, c62, c63), B64(0xa3, c62, c63), B64(0xa4, c62, c63), B64(0xa5, c62, c63), B64(0xa6, c62, c63), B64(0xa7, c62, c63), \
+	B64(0xa8, c62, c63), B64(0xa9, c62, c63), B64(0xaa, c62, c63), B64(0xab, c62, c63), B64(0xac, c62, c63), B64(0xad, c62, c63), B64(0xae, c62, c63), B64(0xaf, c62, c63), \
+	B64(0xb0, c62, c63), B64(0xb1, c62, c63), B64(0xb2, c62, c63), B64(0xb3, c62, c63), B64(0xb4, c62, c63), B64(0xb5, c62, c63), B64(0xb6, c62, c63), B64(0xb7, c62, c63), \
+	B64(0xb8, c62, c63), B64(0xb9, c62, c63), B64(0xba, c62, c63), B64(0xbb, c62, c63), B64(0xbc, c62, c63), B64(0xbd, c62, c63), B64(0xbe, c62, c63), B64(0xbf, c62, c63), \
+	B64(0xc0, c62, c63), B64(0xc1, c62, c63), B64(0xc2, c62, c63), B64(0xc3, c62, c63), B64(0xc4, c62, c63), B64(0xc5, c62, c63), B64(0xc6, c62, c63), B64(0xc7, c62, c63), \
+	B64(0xc8, c62, c63), B64(0xc9, c62, c63), B64(0xca, c62, c63), B64(0xcb, c62, c63), B64(0xcc, c62, c63), B64(0xcd, c62, c63), B64(0xce, c62, c63), B64(0xcf, c62, c63), \
+	B64(0xd0, c62, c63), B64(0xd1, c62, c63), B64(0xd2, c62, c63), B64(0xd3, c62, c63), B64(0xd4, c62, c63), B64(0xd5, c62, c63), B64(0xd6, c62, c63), B64(0xd7, c62, c63), \
+	B64(0xd8, c62, c63), B64(0xd9, c62, c63), B64(0xda, c62, c63), B64(0xdb, c62, c63), B64(0xdc, c62, c63), B64(0xdd, c62, c63), B64(0xde, c62, c63), B64(0xdf, c62, c63), \
+	B64(0xe0, c62, c63), B64(0xe1, c62, c63), B64(0xe2, c62, c63), B64(0xe3, c62, c63), B64(0xe4, c62, c63), B64(0xe5, c62, c63), B64(0xe6, c62, c63), B64(0xe7, c62, c63), \
+	B64(0xe8, c62, c63), B64(0xe9, c62, c63), B64(0xea, c62, c63), B64(0xeb, c62, c63), B64(0xec, c62, c63), B64(0xed, c62, c63), B64(0xee, c62, c63), B64(0xef, c62, c63), \
+	B64(0xf0, c62, c63), B64(0xf1, c62, c63), B64(0xf2, c62, c63), B64(0xf3, c62, c63), B64(0xf4, c62, c63), B64(0xf5, c62, c63), B64(0xf6, c62, c63), B64(0xf7, c62, c63), \
+	B64(0xf8, c62, c63), B64(0xf9, c62, c63), B64(0xfa, c62, c63), B64(0xfb, c62, c63), B64(0xfc, c62, c63), B64(0xfd, c62, c63), B64(0xfe, c62, c63), B64(0xff, c62, c63)
+
+static const signed char b64[0x100] = { B64_TABLE('+', '/') };
+
+static const signed char b64url[0x100] = { B64_TABLE('-', '_') };
 
 #if UCHAR_MAX == 255
 # define uchar_in_range(c) true
@@ -335,6 +361,124 @@ bool base64_decode(const char * in, size_t insize, char * out, size_t * outsize)
 	return true;
 }
 
+/* Fused line kernel: one pass over LINE decodes (or copies) it into
+   OUT and updates the running CRC32 of the raw line.  DECODE, TABLE,
+   UNPADDED and WITH_CRC are constants in every caller, so each wrapper
+   below is a specialization without per-byte branches on the record
+   options.  With UNPADDED the last line may end in 2 or 3 characters
+   instead of a padded quadruple.  */
+static inline size_t line_kernel(const char *line, size_t len, char *out, u_int32_t *crcp,
+		const bool decode, const signed char * const table, const bool unpadded, const bool with_crc) {
+	const unsigned char *in = (const unsigned char*)line;
+	const unsigned char *end = in + len;
+	const unsigned char *data_end = end;
+	char *o = out;
+	u_int32_t crc = with_crc ? *crcp ^ 0xFFFFFFFF : 0;
+
+	if( !decode ) {
+		for(; in < end; ++in) {
+			if( with_crc )
+				crc = crc_step(crc, *in);
+			*o++ = *in;
+		}
+	} else {
+		int a, b, c, d;
+		unsigned char c2, c3;
+		size_t tail;
+
+		while( data_end > in && ('\n' == data_end[-1] || '\r' == data_end[-1]) )
+			--data_end;
+
+		tail = (data_end - in) % 4;
+		if( data_end == in || (unpadded ? 1 == tail : 0 != tail) )
+			return BASE64_KERNEL_FAIL;
+
+		while( in + 4 < data_end ) {
+			a = table[ in[0] ];
+			b = table[ in[1] ];
+			c = table[ in[2] ];
+			d = table[ in[3] ];
+
+			if( (a | b | c | d) < 0 )
+				return BASE64_KERNEL_FAIL;
+
+			*o++ = (a << 2) | (b >> 4);
+			*o++ = (b << 4) | (c >> 2);
+			*o++ = (c << 6) | d;
+
+			if( with_crc ) {
+				crc = crc_step(crc, in[0]);
+				crc = crc_step(crc, in[1]);
+				crc = crc_step(crc, in[2]);
+				crc = crc_step(crc, in[3]);
+			}
+			in += 4;
+		}
+
+		/* The last quadruple may carry '=' padding; missing characters
+		   of an unpadded tail are treated as padding. */
+		c2 = (!unpadded || data_end - in > 2) ? in[2] : '=';
+		c3 = (!unpadded || data_end - in > 3) ? in[3] : '=';
+
+		a = table[ in[0] ];
+		b = table[ in[1] ];
+		c = ('=' == c2 && '=' == c3) ? 0 : table[ c2 ];
+		d = ('=' == c3) ? 0 : table[ c3 ];
+
+		if( (a | b | c | d) < 0 )
+			return BASE64_KERNEL_FAIL;
+
+		*o++ = (a << 2) | (b >> 4);
+		if( '=' != c2 ) {
+			*o++ = (b << 4) | (c >> 2);
+			if( '=' != c3 )
+				*o++ = (c << 6) | d;
+		}
+
+		/* The rest of the line (last quadruple and EOL) goes into the CRC. */
+		if( with_crc )
+			for(; in < end; ++in)
+				crc = crc_step(crc, *in);
+	}
+
+	if( with_crc )
+		*crcp = crc ^ 0xFFFFFFFF;
+
+	return o - out;
+}
+
+static size_t kernel_txt(const char *line, size_t len, char *out, u_int32_t *crc) {
+	return line_kernel(line, len, out, crc, false, NULL, false, false);
+}
+
+static size_t kernel_txt_crc(const char *line, size_t len, char *out, u_int32_t *crc) {
+	return line_kernel(line, len, out, crc, false, NULL, false, true);
+}
+
+static size_t kernel_b64(const char *line, size_t len, char *out, u_int32_t *crc) {
+	return line_kernel(line, len, out, crc, true, b64, false, false);
+}
+
+static size_t kernel_b64_crc(const char *line, size_t len, char *out, u_int32_t *crc) {
+	return line_kernel(line, len, out, crc, true, b64, false, true);
+}
+
+static size_t kernel_b64url(const char *line, size_t len, char *out, u_int32_t *crc) {
+	return line_kernel(line, len, out, crc, true, b64url, true, false);
+}
+
+static size_t kernel_b64url_crc(const char *line, size_t len, char *out, u_int32_t *crc) {
+	return line_kernel(line, len, out, crc, true, b64url, true, true);
+}
+
+base64_kernel base64_kernel_select(bool decode, enum base64_alphabet alphabet, bool crc) {
+	if( decode && BASE64_URL == alphabet )
+		return crc ? kernel_b64url_crc : kernel_b64url;
+	if( decode )
+		return crc ? kernel_b64_crc : kernel_b64;
+	return crc ? kernel_txt_crc : kernel_txt;
+}
+
 /* Allocate an output buffer in *OUT, and decode the base64 encoded
    data stored in IN of size INLEN to the *OUT buffer.  On return, the
    size of the decoded data is stored in *OUTLEN.  OUTLEN may be NULL,
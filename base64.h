@@ -32,17 +32,49 @@
 typedef enum {false, true} bool;
 #endif
 
+/* Get u_int32_t. */
+#include "crc.h"
+
 /* This uses that the expression (n+(k-1))/k means the smallest
    integer >= n/k, i.e., the ceiling of n/k.  */
 #define base64_length(inlen) ((((inlen) + 2) / 3) * 4)
 
+/** Алфавиты base64 (RFC 4648): стандартный и URL-safe ('-' и '_' вместо '+' и '/'). */
+enum base64_alphabet {BASE64_STD, BASE64_URL};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 	bool isbase64(char ch);
 
+	/**
+	 * Ядро распаковки строки записи. За один проход по строке данные
+	 * раскодируются (или копируются), дописываются в out и, при
+	 * необходимости, учитываются в контрольной сумме строк.
+	 * @param line строка (перевод строки в конце допустим)
+	 * @param len длина строки
+	 * @param out буфер результата не короче len
+	 * @param crc контрольная сумма строк (как у crc_calc_string())
+	 * @return длина результата; BASE64_KERNEL_FAIL -- некорректный base64
+	 */
+	typedef size_t (*base64_kernel)(const char *line, size_t len, char *out, u_int32_t *crc);
+
+	/** Результат ядра при ошибке. */
+#define BASE64_KERNEL_FAIL ((size_t)-1)
+
+	/**
+	 * Функция выбора специализации ядра для параметров записи.
+	 * @param decode true -- base64; false -- текст
+	 * @param alphabet алфавит base64; в URL-safe последняя строка может
+	 *        быть без выравнивания '='
+	 * @param crc считать ли контрольную сумму
+	 */
+	base64_kernel base64_kernel_select(bool decode, enum base64_alphabet alphabet, bool crc);
+
 	size_t base64_encode(const char * in, size_t inlen, char * out, size_t outlen);
 
+	size_t base64url_encode(const char * in, size_t inlen, char * out, size_t outlen);
+
 	size_t base64_encode_alloc(const char *in, size_t inlen, char **out);
 
 	bool base64_decode(const char * in, size_t inlen, char * out, size_t *outlen);
@@ -0,0 +1,359 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef __linux__
+/* Get FICLONE. */
+#include <linux/fs.h>
+#endif
+
+#include "extrac4.h"
+#include "cache.h"
+
+/** Размер буфера копирования. */
+#define CACHE_BUFSIZE        (64 * 1024)
+
+/** После вытеснения объём кэша -- не больше этой доли предела (в процентах). */
+#define CACHE_LOW_WATER      (90)
+
+/** Каталог кэша; NULL -- кэш не открыт. */
+static char *cache_dir;
+/** Предельный объём кэша. */
+static off_t cache_max;
+/** Выдавать файлы жёсткими ссылками. */
+static bool cache_link;
+/** Текущий объём кэша; -1 -- ещё не подсчитан. */
+static off_t cache_used = -1;
+
+/** Статистика. */
+static long stat_hits;
+static long stat_misses;
+static long stat_evicted;
+
+/** Файл кэша (при вытеснении). */
+struct cache_file {
+	char *path;
+	off_t size;
+	struct timespec atime;
+};
+
+int cache_open(const char *dir, off_t max_size, bool link) {
+	if( -1 == mkdir(dir, 0755) && EEXIST != errno )
+		return -1;
+
+	if( NULL == (cache_dir = strdup(dir)) )
+		return -1;
+	cache_max = max_size;
+	cache_link = link;
+	cache_used = -1;
+
+	return 0;
+}
+
+void cache_key_init(struct cache_key *key, int format, off_t size, bool has_crc, u_int32_t crc) {
+	memset(key, 0, sizeof(*key));
+	sha256_init(&key->ctx);
+	key->format = format;
+	key->size = size;
+	key->has_crc = has_crc;
+	key->crc = has_crc ? crc : 0;
+}
+
+void cache_key_update(struct cache_key *key, const char *line, size_t len) {
+	u_int64_t n = len;
+
+	/* длина перед строкой: границы строк тоже входят в ключ */
+	sha256_update(&key->ctx, &n, sizeof(n));
+	sha256_update(&key->ctx, line, len);
+
+	key->length += len;
+}
+
+void cache_key_final(struct cache_key *key) {
+	sha256_final(&key->ctx, key->digest);
+}
+
+/**
+ * Функция расчёта прав доступа, с которыми fopen() создаёт файл.
+ */
+static mode_t default_mode() {
+	mode_t mask = umask(0);
+
+	umask(mask);
+	return 0666 & ~mask;
+}
+
+/**
+ * Функция построения путь_имени файла кэша: подкаталог по первому байту
+ * дайджеста, имя -- дайджест и параметры записи.
+ * @return путь_имя (освобождается free()); NULL -- нет памяти
+ */
+static char *entry_path(const struct cache_key *key) {
+	char digest[ 2 * SHA256_DIGEST_SIZE + 1 ];
+	char crc[9] = "-";
+	char *path;
+	int i;
+
+	for(i = 0; i < SHA256_DIGEST_SIZE; ++i)
+		snprintf(digest + 2 * i, 3, "%02x", key->digest[i]);
+
+	if( key->has_crc )
+		snprintf(crc, sizeof(crc), "%08x", (unsigned)key->crc);
+
+	if( -1 == asprintf(&path, "%s/%.2s/%s.%d.%lld.%lld.%s", cache_dir, digest, digest, key->format,
+			(long long)key->length, (long long)key->size, crc) )
+		return NULL;
+
+	return path;
+}
+
+/**
+ * Функция копирования данных файла src в dst: клоном (FICLONE), если
+ * файловая система это умеет, иначе copy_file_range() и, наконец, чтением
+ * и записью.
+ * @return 0 -- успешно; -1 -- ошибка
+ */
+static int copy_fd(int src, int dst) {
+	char buf[ CACHE_BUFSIZE ];
+	ssize_t n;
+
+#ifdef FICLONE
+	if( 0 == ioctl(dst, FICLONE, src) )
+		return 0;
+#endif
+
+	while( 0 < (n = copy_file_range(src, NULL, dst, NULL, 1 << 30, 0)) );
+	if( 0 == n )
+		return 0;
+
+	/* копирование ядром недоступно: продолжаем с текущих позиций */
+	while( 0 < (n = read(src, buf, sizeof(buf))) ) {
+		char *p = buf;
+
+		while( n > 0 ) {
+			ssize_t w = write(dst, p, n);
+
+			if( w <= 0 )
+				return -1;
+			p += w;
+			n -= w;
+		}
+	}
+
+	return 0 == n ? 0 : -1;
+}
+
+/**
+ * Сравнение файлов кэша по времени последнего обращения.
+ */
+static int compare_atime(const void *a, const void *b) {
+	const struct cache_file *x = (const struct cache_file*)a;
+	const struct cache_file *y = (const struct cache_file*)b;
+
+	if( x->atime.tv_sec != y->atime.tv_sec )
+		return x->atime.tv_sec < y->atime.tv_sec ? -1 : 1;
+	if( x->atime.tv_nsec != y->atime.tv_nsec )
+		return x->atime.tv_nsec < y->atime.tv_nsec ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Процедура подсчёта объёма кэша и, если он больше предела, вытеснения
+ * файлов, к которым дольше всего не обращались (время обращения
+ * выставляется явно при каждой выдаче файла).
+ */
+static void cache_evict() {
+	struct cache_file *files = NULL;
+	size_t nfiles = 0;
+	size_t cap = 0;
+	struct dirent *d;
+	off_t total = 0;
+	size_t i;
+	DIR *top;
+
+	if( NULL == (top = opendir(cache_dir)) )
+		return;
+
+	while( NULL != (d = readdir(top)) ) {
+		struct dirent *e;
+		char *sub;
+		DIR *dir;
+
+		if( '.' == d->d_name[0] || -1 == asprintf(&sub, "%s/%s", cache_dir, d->d_name) )
+			continue;
+
+		if( NULL != (dir = opendir(sub)) ) {
+			while( NULL != (e = readdir(dir)) ) {
+				struct stat st;
+
+				if( 0 != fstatat(dirfd(dir), e->d_name, &st, AT_SYMLINK_NOFOLLOW) || !S_ISREG(st.st_mode) )
+					continue;
+
+				if( nfiles == cap ) {
+					struct cache_file *f = (struct cache_file*)realloc(files, (cap = cap ? 2 * cap : 256) * sizeof(*f));
+
+					if( NULL == f )
+						break;
+					files = f;
+				}
+
+				if( -1 == asprintf(&files[nfiles].path, "%s/%s", sub, e->d_name) )
+					break;
+				files[nfiles].size = st.st_size;
+				files[nfiles].atime = st.st_atim;
+				total += st.st_size;
+				++nfiles;
+			}
+			closedir(dir);
+		}
+		free(sub);
+	}
+	closedir(top);
+
+	if( total > cache_max ) {
+		qsort(files, nfiles, sizeof(*files), compare_atime);
+
+		for(i = 0; i < nfiles && total > cache_max / 100 * CACHE_LOW_WATER; ++i) {
+			if( 0 == unlink(files[i].path) ) {
+				total -= files[i].size;
+				++stat_evicted;
+			}
+		}
+	}
+
+	for(i = 0; i < nfiles; ++i)
+		free(files[i].path);
+	free(files);
+
+	cache_used = total;
+}
+
+int cache_materialize(const struct cache_key *key, const char *pathname, long mode) {
+	struct timespec times[2] = {{0, UTIME_NOW}, {0, UTIME_OMIT}};
+	struct stat st;
+	char *path;
+	int src;
+	int dst;
+	int rc = -1;
+
+	/* файл могла оставить ссылка на кэш: пишем не в него, а в новый */
+	if( -1 == unlink(pathname) && ENOENT != errno )
+		return -1;
+
+	if( NULL == (path = entry_path(key)) )
+		return -1;
+
+	if( -1 == (src = open(path, O_RDONLY)) ) {
+		++stat_misses;
+		free(path);
+		return -1;
+	}
+
+	if( 0 != fstat(src, &st) || (-1 != key->size && st.st_size != key->size) ) {
+		++stat_misses;
+		close(src);
+		free(path);
+		return -1;
+	}
+
+	/* отметка обращения для вытеснения -- явно, независимо от relatime */
+	futimens(src, times);
+
+	/* ссылка получает права файла кэша: ссылаемся, только если они те же, что у нового файла */
+	if( cache_link && -1 == mode && (st.st_mode & 07777) == default_mode() && 0 == link(path, pathname) )
+		rc = 0;
+	else if( -1 != (dst = open(pathname, O_WRONLY | O_CREAT | O_TRUNC, 0666)) ) {
+		if( (-1 == mode || 0 == fchmod(dst, (mode_t)mode)) && 0 == copy_fd(src, dst) )
+			rc = 0;
+		if( 0 != close(dst) )
+			rc = -1;
+		if( 0 != rc )
+			unlink(pathname);
+	}
+
+	if( 0 == rc )
+		++stat_hits;
+	else
+		++stat_misses;
+
+	close(src);
+	free(path);
+	return rc;
+}
+
+void cache_insert(const struct cache_key *key, const char *pathname) {
+	struct stat st;
+	char *path;
+	char *tmp = NULL;
+	char *slash;
+	int src = -1;
+	int dst = -1;
+
+	if( NULL == (path = entry_path(key)) )
+		return;
+
+	/* подкаталог по первому байту дайджеста */
+	slash = strrchr(path, '/');
+	*slash = '\0';
+	if( -1 == mkdir(path, 0755) && EEXIST != errno )
+		goto _done;
+	*slash = '/';
+
+	if( -1 == asprintf(&tmp, "%s.XXXXXX", path) ) {
+		tmp = NULL;
+		goto _done;
+	}
+
+	if( -1 == (src = open(pathname, O_RDONLY)) || 0 != fstat(src, &st) )
+		goto _done;
+
+	if( -1 == (dst = mkstemp(tmp)) ) {
+		free(tmp);
+		tmp = NULL;
+		goto _done;
+	}
+
+	/* права, как у извлечённого файла (mkstemp() создаёт файл с правами 0600) */
+	if( 0 != fchmod(dst, default_mode()) || 0 != copy_fd(src, dst) || 0 != close(dst) || 0 != rename(tmp, path) ) {
+		dst = -1;
+		unlink(tmp);
+		goto _done;
+	}
+	dst = -1;
+
+	/* объём кэша подсчитывается при первой вставке, а не при каждом запуске */
+	if( -1 == cache_used )
+		cache_evict();
+	else if( (cache_used += st.st_size) > cache_max )
+		cache_evict();
+
+ _done:
+	if( -1 != dst )
+		close(dst);
+	if( -1 != src )
+		close(src);
+	free(tmp);
+	free(path);
+}
+
+void cache_close() {
+	if( NULL == cache_dir )
+		return;
+
+	if( !(flags & QUIET) )
+		fprintf(stderr, "Output cache: %ld hit(s), %ld miss(es), %ld evicted.\n", stat_hits, stat_misses, stat_evicted);
+
+	free(cache_dir);
+	cache_dir = NULL;
+}
@@ -0,0 +1,83 @@
+#ifndef __cache_h__
+#define __cache_h__
+
+#include <sys/types.h>
+
+/* Get BOOL. */
+#include "base64.h"
+
+/* Get u_int32_t. */
+#include "crc.h"
+
+#include "sha256.h"
+
+/**
+ * Ключ кэша извлечённых файлов: дайджест SHA-256 строк данных записи (как
+ * они записаны в контейнере) и параметры, от которых зависит результат.
+ */
+struct cache_key {
+	struct sha256 ctx;
+	unsigned char digest[ SHA256_DIGEST_SIZE ];
+	/* длина строк данных */
+	off_t length;
+	/* формат, объявленный размер (-1 -- не задан) и контрольная сумма */
+	int format;
+	off_t size;
+	bool has_crc;
+	u_int32_t crc;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	/**
+	 * Функция открытия кэша извлечённых файлов (--output-cache).
+	 * @param dir каталог кэша (создаётся при необходимости)
+	 * @param max_size предельный объём кэша; при превышении удаляются
+	 *        файлы, к которым дольше всего не обращались
+	 * @param link выдавать файлы жёсткими ссылками на файлы кэша
+	 * @return 0 -- успешно; -1 -- ошибка (errno)
+	 */
+	int cache_open(const char *dir, off_t max_size, bool link);
+
+	/**
+	 * Процедура начала расчёта ключа записи.
+	 */
+	void cache_key_init(struct cache_key *key, int format, off_t size, bool has_crc, u_int32_t crc);
+
+	/**
+	 * Процедура добавления строки данных записи в ключ.
+	 */
+	void cache_key_update(struct cache_key *key, const char *line, size_t len);
+
+	/**
+	 * Процедура завершения расчёта ключа (после последней строки данных).
+	 */
+	void cache_key_final(struct cache_key *key);
+
+	/**
+	 * Функция выдачи файла из кэша: pathname создаётся клоном файла кэша
+	 * (FICLONE), жёсткой ссылкой (если запрошено и mode не задан) либо
+	 * копией. Ветка каталогов pathname должна существовать.
+	 * @param mode права доступа нового файла; -1 -- по умолчанию
+	 * @return 0 -- файл выдан; -1 -- файла нет в кэше или он не выдан
+	 */
+	int cache_materialize(const struct cache_key *key, const char *pathname, long mode);
+
+	/**
+	 * Процедура добавления извлечённого файла pathname в кэш (клоном или
+	 * копией -- у файла кэша собственные данные). Ошибки не сообщаются:
+	 * кэш лишь ускоряет извлечение.
+	 */
+	void cache_insert(const struct cache_key *key, const char *pathname);
+
+	/**
+	 * Процедура закрытия кэша: вывод статистики (без -q).
+	 */
+	void cache_close();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__cache_h__*/
@@ -0,0 +1,653 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "extrac4.h"
+#include "catalog.h"
+
+/** Сигнатура и версия файла каталога. */
+#define CATALOG_MAGIC        ("extrac4c")
+#define CATALOG_MAGIC_LEN    (8)
+#define CATALOG_VERSION      (1)
+
+/** Суффикс временного файла каталога. */
+#define CATALOG_TMP          (".tmp")
+
+/** Предельное число процессов просмотра контейнеров. */
+#define CATALOG_MAX_WORKERS  (16)
+
+/** Флаги записи каталога. */
+#define CATALOG_CRC          (1)
+#define CATALOG_DELTA        (2)
+/** Контейнер не удалось просмотреть (только при передаче от процесса просмотра). */
+#define CATALOG_FAILED       (4)
+
+/*
+ * Файл каталога (порядок байтов -- родной для машины):
+ *   заголовок;
+ *   таблица контейнеров (записи каждого контейнера идут подряд);
+ *   таблица записей;
+ *   хэш-таблица по путь_имени записи: номер первой записи цепочки + 1;
+ *   строки, завершённые нулём.
+ */
+struct catalog_header {
+	char magic[ CATALOG_MAGIC_LEN ];
+	u_int32_t version;
+	u_int32_t ncontainers;
+	u_int64_t nrecords;
+	u_int64_t nbuckets;
+	u_int64_t strings_len;
+};
+
+struct catalog_container {
+	/* смещение путь_имени в таблице строк */
+	u_int64_t name;
+	u_int64_t first;
+	u_int64_t count;
+	/* признаки актуальности */
+	int64_t size;
+	int64_t mtime;
+	int64_t mtime_nsec;
+	u_int64_t dev;
+	u_int64_t ino;
+};
+
+struct catalog_record {
+	u_int64_t name;
+	/* следующая запись цепочки + 1; 0 -- конец */
+	u_int64_t next;
+	int64_t offset;
+	int64_t size;
+	u_int32_t container;
+	u_int32_t crc;
+	u_int32_t flags;
+	u_int32_t reserved;
+};
+
+/** Открытый каталог. */
+static char *map;
+static size_t map_len;
+static const struct catalog_header *head;
+static const struct catalog_container *containers;
+static const struct catalog_record *records;
+static const u_int64_t *buckets;
+static const char *strings;
+
+/** Запись, найденная процессом просмотра; за ней следует путь_имя. */
+struct scan_item {
+	u_int32_t container;
+	u_int32_t flags;
+	u_int32_t crc;
+	u_int32_t name_len;
+	int64_t offset;
+	int64_t size;
+};
+
+/** Запись, найденная при просмотре контейнера. */
+struct build_record {
+	char *name;
+	struct scan_item item;
+};
+
+/** Контейнер строящегося каталога. */
+struct build_container {
+	/* абсолютный путь_имя: каталог действителен из любого текущего каталога */
+	char *name;
+	struct stat st;
+	bool failed;
+	/* контейнер не изменился: записи берутся из прежнего каталога */
+	long old;
+	/* иначе -- просмотренные записи */
+	struct build_record *records;
+	size_t nrecords;
+	size_t cap;
+};
+
+/**
+ * Функция расчёта хэша строки (FNV-1a).
+ */
+static u_int64_t hash(const char *s) {
+	u_int64_t h = 0xcbf29ce484222325ULL;
+
+	for(; '\0' != *s; ++s)
+		h = (h ^ (unsigned char)*s) * 0x100000001b3ULL;
+	return h;
+}
+
+int catalog_open(const char *pathname) {
+	const struct catalog_header *h;
+	struct stat st;
+	u_int64_t size;
+	u_int64_t i;
+	int fd;
+
+	catalog_close();
+
+	if( -1 == (fd = open(pathname, O_RDONLY)) )
+		return -1;
+
+	if( -1 == fstat(fd, &st) || (size_t)st.st_size < sizeof(*h) ) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	map = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if( MAP_FAILED == map ) {
+		map = NULL;
+		return -1;
+	}
+	map_len = st.st_size;
+	h = (const struct catalog_header*)map;
+
+	/* размеры таблиц должны сойтись с размером файла */
+	size = sizeof(*h);
+	if( 0 != memcmp(h->magic, CATALOG_MAGIC, CATALOG_MAGIC_LEN) || CATALOG_VERSION != h->version
+			|| h->nrecords > map_len / sizeof(struct catalog_record) || h->nbuckets > map_len / sizeof(u_int64_t)
+			|| 0 == h->nbuckets || 0 != (h->nbuckets & (h->nbuckets - 1)) || 0 == h->strings_len
+			|| (size += h->ncontainers * sizeof(struct catalog_container) + h->nrecords * sizeof(struct catalog_record)
+				+ h->nbuckets * sizeof(u_int64_t) + h->strings_len) != map_len ) {
+		catalog_close();
+		errno = EINVAL;
+		return -1;
+	}
+
+	head = h;
+	containers = (const struct catalog_container*)(h + 1);
+	records = (const struct catalog_record*)(containers + h->ncontainers);
+	buckets = (const u_int64_t*)(records + h->nrecords);
+	strings = (const char*)(buckets + h->nbuckets);
+
+	if( '\0' != strings[ h->strings_len - 1 ] ) {
+		catalog_close();
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* смещения строк и номера записей и контейнеров -- в пределах таблиц */
+	for(i = 0; i < h->ncontainers; ++i) {
+		if( containers[i].name >= h->strings_len || containers[i].first > h->nrecords
+				|| containers[i].count > h->nrecords - containers[i].first ) {
+			catalog_close();
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	for(i = 0; i < h->nrecords; ++i) {
+		if( records[i].name >= h->strings_len || records[i].container >= h->ncontainers ) {
+			catalog_close();
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+void catalog_close() {
+	if( NULL != map )
+		munmap(map, map_len);
+	map = NULL;
+	map_len = 0;
+	head = NULL;
+}
+
+int catalog_find(const char *path, struct catalog_entry *entry) {
+	return catalog_find_nth(path, 0, entry);
+}
+
+int catalog_find_nth(const char *path, u_int64_t nth, struct catalog_entry *entry) {
+	u_int64_t i;
+	u_int64_t steps = 0;
+
+	if( NULL == head )
+		return -1;
+
+	for(i = buckets[ hash(path) & (head->nbuckets - 1) ]; 0 != i && i <= head->nrecords && steps++ < head->nrecords; i = records[i - 1].next) {
+		const struct catalog_record *r = &records[i - 1];
+		const struct catalog_container *c;
+
+		if( 0 != strcmp(strings + r->name, path) || 0 != nth-- )
+			continue;
+
+		c = &containers[ r->container ];
+		entry->container = strings + c->name;
+		entry->offset = r->offset;
+		entry->size = r->size;
+		entry->has_crc = 0 != (r->flags & CATALOG_CRC);
+		entry->crc = r->crc;
+		entry->delta = 0 != (r->flags & CATALOG_DELTA);
+		entry->container_size = c->size;
+		entry->mtime = c->mtime;
+		entry->mtime_nsec = c->mtime_nsec;
+		return 0;
+	}
+
+	return -1;
+}
+
+/** Упорядоченный по путь_имени список контейнеров прежнего каталога. */
+static u_int32_t *old_sorted;
+
+static int old_compare(const void *a, const void *b) {
+	return strcmp(strings + containers[ *(const u_int32_t*)a ].name, strings + containers[ *(const u_int32_t*)b ].name);
+}
+
+/**
+ * Функция поиска контейнера в прежнем каталоге.
+ * @return номер контейнера; -1 -- не найден
+ */
+static long old_find(const char *name) {
+	size_t lo = 0;
+	size_t hi = NULL != head ? head->ncontainers : 0;
+
+	while( lo < hi ) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = strcmp(name, strings + containers[ old_sorted[mid] ].name);
+
+		if( 0 == cmp )
+			return old_sorted[mid];
+		if( cmp < 0 )
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return -1;
+}
+
+/**
+ * Функция просмотра контейнера: найденные записи пишутся в out.
+ * @return 0 -- успешно; -1 -- ошибка открытия или чтения
+ */
+static int scan_container(u_int32_t index, const char *pathname, FILE *out) {
+	char line[ MAX_LINESIZE ];
+	FILE *in;
+	bool ok;
+
+	if( !(in = open_input(pathname)) )
+		return -1;
+
+	in_pathname = (char*)pathname;
+	in_offset = 0;
+
+	while( 1 ) {
+		off_t offset = in_offset;
+		char *b = find_tag(line, sizeof(line), in);
+
+		if( NULL == b )
+			break;
+
+		init_record();
+		if( parse_tag(b) ) {
+			struct scan_item item;
+
+			memset(&item, 0, sizeof(item));
+			item.container = index;
+			item.flags = (crc_check_flag ? CATALOG_CRC : 0) | (delta_flag ? CATALOG_DELTA : 0);
+			item.crc = crc_check_flag ? crc_old_value : 0;
+			item.name_len = strlen(out_pathname);
+			item.offset = offset;
+			item.size = out_size;
+
+			if( 1 != fwrite(&item, sizeof(item), 1, out) || 1 != fwrite(out_pathname, item.name_len, 1, out) )
+				break;
+		}
+
+		/* запись с индексом пропускается без чтения данных */
+		if( !skip_index(line, sizeof(line), in) )
+			skip_record(line, sizeof(line), in);
+	}
+
+	ok = !ferror(in) && !ferror(out);
+	fclose(in);
+	return ok ? 0 : -1;
+}
+
+/**
+ * Процедура процесса просмотра: забирает очередной контейнер из общего
+ * счётчика, пока контейнеры не кончатся.
+ */
+static void scan_worker(u_int32_t *next, struct build_container *bc, const u_int32_t *todo, u_int32_t ntodo, FILE *out) {
+	u_int32_t i;
+
+	while( (i = __atomic_fetch_add(next, 1, __ATOMIC_RELAXED)) < ntodo ) {
+		if( 0 != scan_container(todo[i], bc[ todo[i] ].name, out) ) {
+			struct scan_item item;
+
+			memset(&item, 0, sizeof(item));
+			item.container = todo[i];
+			item.flags = CATALOG_FAILED;
+			fwrite(&item, sizeof(item), 1, out);
+		}
+	}
+
+	_exit(0 != fflush(out) || ferror(out) ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/**
+ * Функция чтения результатов процесса просмотра.
+ * @return 0 -- успешно; -1 -- ошибка
+ */
+static int scan_collect(struct build_container *bc, u_int32_t nfiles, FILE *f) {
+	struct scan_item item;
+
+	rewind(f);
+
+	while( 1 == fread(&item, sizeof(item), 1, f) ) {
+		struct build_container *c;
+		struct build_record *r;
+
+		if( item.container >= nfiles )
+			return -1;
+		c = &bc[ item.container ];
+
+		if( (item.flags & CATALOG_FAILED) ) {
+			c->failed = true;
+			continue;
+		}
+
+		if( c->nrecords == c->cap ) {
+			c->cap = c->cap ? 2 * c->cap : 16;
+			if( NULL == (r = (struct build_record*)realloc(c->records, c->cap * sizeof(*r))) )
+				return -1;
+			c->records = r;
+		}
+
+		r = &c->records[ c->nrecords ];
+		r->item = item;
+		if( NULL == (r->name = (char*)malloc(item.name_len + 1)) )
+			return -1;
+		if( 0 != item.name_len && 1 != fread(r->name, item.name_len, 1, f) ) {
+			free(r->name);
+			return -1;
+		}
+		r->name[ item.name_len ] = '\0';
+		++c->nrecords;
+	}
+
+	return ferror(f) ? -1 : 0;
+}
+
+/**
+ * Функция параллельного просмотра изменившихся контейнеров.
+ * Разбор записей пользуется глобальным состоянием extrac4, поэтому
+ * контейнеры просматриваются в отдельных процессах; каждый пишет
+ * найденное во временный файл, который затем читает родитель.
+ * @return 0 -- успешно; -1 -- ошибка
+ */
+static int scan(struct build_container *bc, u_int32_t nfiles, const u_int32_t *todo, u_int32_t ntodo) {
+	FILE *out[ CATALOG_MAX_WORKERS ];
+	pid_t pid[ CATALOG_MAX_WORKERS ];
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	u_int32_t *next;
+	int nworkers;
+	int rc = 0;
+	int i;
+
+	nworkers = ncpu < 1 ? 1 : ncpu > CATALOG_MAX_WORKERS ? CATALOG_MAX_WORKERS : (int)ncpu;
+	if( (u_int32_t)nworkers > ntodo )
+		nworkers = (int)ntodo;
+
+	next = (u_int32_t*)mmap(NULL, sizeof(*next), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if( MAP_FAILED == next )
+		return -1;
+	*next = 0;
+
+	/* буферы вывода не должны достаться процессам просмотра */
+	fflush(NULL);
+
+	for(i = 0; i < nworkers; ++i) {
+		if( NULL == (out[i] = tmpfile()) )
+			break;
+		if( -1 == (pid[i] = fork()) ) {
+			fclose(out[i]);
+			break;
+		}
+		if( 0 == pid[i] )
+			scan_worker(next, bc, todo, ntodo, out[i]);
+	}
+
+	if( 0 == (nworkers = i) )
+		rc = -1;
+
+	for(i = 0; i < nworkers; ++i) {
+		int status;
+
+		if( -1 == waitpid(pid[i], &status, 0) || !WIFEXITED(status) || EXIT_SUCCESS != WEXITSTATUS(status) )
+			rc = -1;
+	}
+
+	for(i = 0; i < nworkers; ++i) {
+		if( 0 == rc && 0 != scan_collect(bc, nfiles, out[i]) )
+			rc = -1;
+		fclose(out[i]);
+	}
+
+	munmap(next, sizeof(*next));
+	return rc;
+}
+
+/**
+ * Функция записи нового каталога во временный файл и замены им прежнего.
+ * Записи неизменившихся контейнеров копируются из открытого прежнего каталога.
+ * @return 0 -- успешно; -1 -- ошибка (errno)
+ */
+static int catalog_write(const char *pathname, struct build_container *bc, u_int32_t nfiles, u_int64_t *total) {
+	struct catalog_header h;
+	struct catalog_container *cs = NULL;
+	struct catalog_record *rs = NULL;
+	u_int64_t *bs = NULL;
+	char *pool = NULL;
+	char *tmp = NULL;
+	u_int64_t pos = 0;
+	u_int32_t i, ci = 0;
+	u_int64_t j, ri = 0;
+	FILE *f = NULL;
+	int rc = -1;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CATALOG_MAGIC, CATALOG_MAGIC_LEN);
+	h.version = CATALOG_VERSION;
+
+	/* размеры таблиц */
+	for(i = 0; i < nfiles; ++i) {
+		const struct build_container *c = &bc[i];
+
+		if( c->failed )
+			continue;
+		++h.ncontainers;
+		h.strings_len += strlen(c->name) + 1;
+		if( -1 != c->old ) {
+			h.nrecords += containers[ c->old ].count;
+			for(j = 0; j < containers[ c->old ].count; ++j)
+				h.strings_len += strlen(strings + records[ containers[ c->old ].first + j ].name) + 1;
+		} else {
+			h.nrecords += c->nrecords;
+			for(j = 0; j < c->nrecords; ++j)
+				h.strings_len += c->records[j].item.name_len + 1;
+		}
+	}
+	for(h.nbuckets = 16; h.nbuckets < 2 * h.nrecords; h.nbuckets <<= 1);
+	if( 0 == h.strings_len )
+		h.strings_len = 1;
+
+	if( NULL == (cs = (struct catalog_container*)calloc(h.ncontainers + 1, sizeof(*cs)))
+			|| NULL == (rs = (struct catalog_record*)calloc(h.nrecords + 1, sizeof(*rs)))
+			|| NULL == (bs = (u_int64_t*)calloc(h.nbuckets, sizeof(*bs)))
+			|| NULL == (pool = (char*)calloc(h.strings_len, 1)) )
+		goto _done;
+
+	for(i = 0; i < nfiles; ++i) {
+		const struct build_container *c = &bc[i];
+		struct catalog_container *cc;
+		u_int64_t count;
+
+		if( c->failed )
+			continue;
+
+		cc = &cs[ci];
+		cc->name = pos;
+		pos += strlen(strcpy(pool + pos, c->name)) + 1;
+		cc->first = ri;
+		cc->size = c->st.st_size;
+		cc->mtime = c->st.st_mtim.tv_sec;
+		cc->mtime_nsec = c->st.st_mtim.tv_nsec;
+		cc->dev = c->st.st_dev;
+		cc->ino = c->st.st_ino;
+
+		count = -1 != c->old ? containers[ c->old ].count : c->nrecords;
+		for(j = 0; j < count; ++j, ++ri) {
+			struct catalog_record *r = &rs[ri];
+			u_int64_t *bucket;
+			const char *name;
+
+			if( -1 != c->old ) {
+				*r = records[ containers[ c->old ].first + j ];
+				name = strings + r->name;
+			} else {
+				const struct scan_item *item = &c->records[j].item;
+
+				memset(r, 0, sizeof(*r));
+				r->offset = item->offset;
+				r->size = item->size;
+				r->crc = item->crc;
+				r->flags = item->flags;
+				name = c->records[j].name;
+			}
+
+			r->container = ci;
+			r->name = pos;
+			pos += strlen(strcpy(pool + pos, name)) + 1;
+
+			/* новая запись -- в голову цепочки: при повторах находится последняя */
+			bucket = &bs[ hash(name) & (h.nbuckets - 1) ];
+			r->next = *bucket;
+			*bucket = ri + 1;
+		}
+		cc->count = ri - cc->first;
+		++ci;
+	}
+
+	if( NULL == (tmp = (char*)malloc(strlen(pathname) + sizeof(CATALOG_TMP))) )
+		goto _done;
+	strcpy(tmp, pathname);
+	strcat(tmp, CATALOG_TMP);
+
+	if( NULL == (f = fopen(tmp, "wb")) )
+		goto _done;
+
+	if( 1 != fwrite(&h, sizeof(h), 1, f)
+			|| (0 != h.ncontainers && 1 != fwrite(cs, h.ncontainers * sizeof(*cs), 1, f))
+			|| (0 != h.nrecords && 1 != fwrite(rs, h.nrecords * sizeof(*rs), 1, f))
+			|| 1 != fwrite(bs, h.nbuckets * sizeof(*bs), 1, f)
+			|| 1 != fwrite(pool, h.strings_len, 1, f)
+			|| 0 != fflush(f) || 0 != fsync(fileno(f)) ) {
+		fclose(f);
+		remove(tmp);
+		goto _done;
+	}
+
+	if( 0 != fclose(f) || 0 != rename(tmp, pathname) ) {
+		remove(tmp);
+		goto _done;
+	}
+
+	*total = h.nrecords;
+	rc = 0;
+
+ _done:
+	free(tmp);
+	free(pool);
+	free(bs);
+	free(rs);
+	free(cs);
+	return rc;
+}
+
+int catalog_build(const char *pathname, char **files, int nfiles) {
+	struct build_container *bc;
+	u_int32_t *todo;
+	u_int32_t ntodo = 0;
+	u_int64_t total = 0;
+	int rc = -1;
+	int i;
+
+	if( NULL == (bc = (struct build_container*)calloc(nfiles + 1, sizeof(*bc)))
+			|| NULL == (todo = (u_int32_t*)calloc(nfiles + 1, sizeof(*todo))) ) {
+		free(bc);
+		fprintf(stderr, "%s: %s\n", pathname, "Can't build catalog.");
+		return -1;
+	}
+
+	/* прежний каталог: неизменившиеся контейнеры не просматриваются */
+	if( 0 == catalog_open(pathname) && NULL != (old_sorted = (u_int32_t*)malloc((head->ncontainers + 1) * sizeof(*old_sorted))) ) {
+		u_int32_t k;
+
+		for(k = 0; k < head->ncontainers; ++k)
+			old_sorted[k] = k;
+		qsort(old_sorted, head->ncontainers, sizeof(*old_sorted), old_compare);
+	} else
+		catalog_close();
+
+	for(i = 0; i < nfiles; ++i) {
+		struct build_container *c = &bc[i];
+		long k;
+
+		c->old = -1;
+
+		if( NULL == (c->name = realpath(files[i], NULL)) || -1 == stat(c->name, &c->st) ) {
+			fprintf(stderr, "Can't open input file '%s'.\n", files[i]);
+			c->failed = true;
+			continue;
+		}
+
+		if( NULL != head && -1 != (k = old_find(c->name))
+				&& (u_int64_t)c->st.st_dev == containers[k].dev && (u_int64_t)c->st.st_ino == containers[k].ino
+				&& c->st.st_size == containers[k].size && c->st.st_mtim.tv_sec == containers[k].mtime
+				&& c->st.st_mtim.tv_nsec == containers[k].mtime_nsec )
+			c->old = k;
+		else
+			todo[ ntodo++ ] = i;
+	}
+
+	if( 0 != ntodo && 0 != scan(bc, nfiles, todo, ntodo) )
+		fprintf(stderr, "%s: %s\n", pathname, "Can't scan containers.");
+	else if( 0 != catalog_write(pathname, bc, nfiles, &total) )
+		fprintf(stderr, "%s: %s: %s\n", pathname, "Can't write catalog", strerror(errno));
+	else {
+		if( !(flags & QUIET) )
+			fprintf(stderr, "Catalog '%s': %d container(s), %lu scanned, %llu record(s).\n",
+					pathname, nfiles, (unsigned long)ntodo, (unsigned long long)total);
+		rc = 0;
+	}
+
+	for(i = 0; i < nfiles; ++i) {
+		size_t j;
+
+		for(j = 0; j < bc[i].nrecords; ++j)
+			free(bc[i].records[j].name);
+		free(bc[i].records);
+		free(bc[i].name);
+		if( bc[i].failed )
+			rc = -1;
+	}
+	free(bc);
+	free(todo);
+	free(old_sorted);
+	old_sorted = NULL;
+	catalog_close();
+
+	return rc;
+}
@@ -0,0 +1,74 @@
+#ifndef __catalog_h__
+#define __catalog_h__
+
+#include <sys/types.h>
+#include <time.h>
+
+/* Get u_int32_t. */
+#include "crc.h"
+
+/** Запись каталога, найденная catalog_find(). */
+struct catalog_entry {
+	/* путь_имя контейнера и смещение строки, с которой find_tag() находит запись */
+	const char *container;
+	off_t offset;
+	/* объявленный размер (!size); -1 -- не задан */
+	off_t size;
+	/* контрольная сумма из заголовка записи */
+	int has_crc;
+	u_int32_t crc;
+	/* разностная запись (!delta): применяется к результату предыдущих */
+	int delta;
+	/* признаки контейнера на момент построения каталога */
+	off_t container_size;
+	time_t mtime;
+	long mtime_nsec;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	/**
+	 * Функция построения (обновления) каталога записей контейнеров.
+	 * Контейнеры просматриваются параллельно несколькими процессами;
+	 * записи контейнеров, у которых не изменились устройство, inode, размер
+	 * и время модификации, переносятся из прежнего каталога без просмотра.
+	 * Каталог заменяется переименованием временного файла.
+	 * @param pathname путь_имя каталога
+	 * @param files список контейнеров
+	 * @return 0 -- успешно; -1 -- ошибка (сообщение выведено)
+	 */
+	int catalog_build(const char *pathname, char **files, int nfiles);
+
+	/**
+	 * Функция открытия каталога (файл отображается в память). Смещения
+	 * строк и номера записей и контейнеров проверяются при открытии.
+	 * @return 0 -- успешно; -1 -- каталог не прочитан или испорчен
+	 */
+	int catalog_open(const char *pathname);
+
+	/**
+	 * Функция поиска записи по путь_имени; при повторах -- последняя
+	 * (в порядке контейнеров при построении), как при извлечении в файлы.
+	 * Строки записи действительны до catalog_close().
+	 * @return 0 -- найдена; -1 -- нет такой записи
+	 */
+	int catalog_find(const char *path, struct catalog_entry *entry);
+
+	/**
+	 * Функция поиска записи по путь_имени, nth-й от последней (0 -- то же,
+	 * что catalog_find()): по ней восстанавливается цепочка разностных записей.
+	 * @return 0 -- найдена; -1 -- нет такой записи
+	 */
+	int catalog_find_nth(const char *path, u_int64_t nth, struct catalog_entry *entry);
+
+	/**
+	 * Процедура закрытия каталога.
+	 */
+	void catalog_close();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__catalog_h__*/
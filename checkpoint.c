@@ -0,0 +1,128 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "checkpoint.h"
+
+/** Первая строка журнала. */
+#define CHECKPOINT_MAGIC     ("extrac4-checkpoint 2\n")
+
+/** Суффикс временного файла журнала. */
+#define CHECKPOINT_TMP       (".tmp")
+
+/**
+ * Функция чтения строки журнала без перевода строки.
+ * @return 0 -- успешно; -1 -- конец файла или ошибка
+ */
+static int read_pathname(FILE *f, char **pathname) {
+	size_t size = 0;
+	ssize_t len;
+
+	if( -1 == (len = getline(pathname, &size, f)) )
+		return -1;
+	if( len > 0 && '\n' == (*pathname)[len - 1] )
+		(*pathname)[len - 1] = '\0';
+	return 0;
+}
+
+int checkpoint_load(const char *journal, struct checkpoint *cp) {
+	char magic[ sizeof(CHECKPOINT_MAGIC) ];
+	long long offset;
+	int rc = 0;
+	int i;
+	FILE *f;
+
+	memset(cp, 0, sizeof(*cp));
+
+	if( NULL == (f = fopen(journal, "r")) )
+		return -1;
+
+	if( NULL == fgets(magic, sizeof(magic), f) || 0 != strcmp(magic, CHECKPOINT_MAGIC)
+			|| 4 != fscanf(f, "%d %lld %d %d", &cp->input, &offset, &cp->found, &cp->extracted)
+			|| '\n' != fgetc(f) || 0 != read_pathname(f, &cp->pathname)
+			|| cp->input < 0 || offset < 0
+			|| 1 != fscanf(f, "%d", &cp->nfailed) || '\n' != fgetc(f)
+			|| cp->nfailed < 0 || cp->nfailed > CHECKPOINT_MAX_FAILED )
+		rc = -1;
+	cp->offset = offset;
+
+	for(i = 0; 0 == rc && i < cp->nfailed; ++i) {
+		struct checkpoint_failed *failed = &cp->failed[i];
+
+		if( 2 != fscanf(f, "%d %lld", &failed->input, &offset) || ' ' != fgetc(f)
+				|| 0 != read_pathname(f, &failed->pathname) || failed->input < 0 || offset < 0 )
+			rc = -1;
+		failed->offset = offset;
+	}
+
+	fclose(f);
+
+	if( 0 != rc ) {
+		checkpoint_free(cp);
+		errno = EINVAL;
+	}
+	return rc;
+}
+
+void checkpoint_free(struct checkpoint *cp) {
+	int i;
+
+	for(i = 0; i < CHECKPOINT_MAX_FAILED; ++i) {
+		free(cp->failed[i].pathname);
+		cp->failed[i].pathname = NULL;
+	}
+	free(cp->pathname);
+	cp->pathname = NULL;
+}
+
+int checkpoint_save(const char *journal, const struct checkpoint *cp) {
+	char *tmp;
+	FILE *f;
+	int rc = 0;
+	int i;
+
+	if( NULL == (tmp = (char*)malloc(strlen(journal) + sizeof(CHECKPOINT_TMP))) )
+		return -1;
+	strcpy(tmp, journal);
+	strcat(tmp, CHECKPOINT_TMP);
+
+	if( NULL == (f = fopen(tmp, "w")) ) {
+		free(tmp);
+		return -1;
+	}
+
+	if( 0 > fprintf(f, "%s%d %lld %d %d\n%s\n%d\n", CHECKPOINT_MAGIC, cp->input, (long long)cp->offset,
+				cp->found, cp->extracted, cp->pathname, cp->nfailed) )
+		rc = -1;
+	for(i = 0; 0 == rc && i < cp->nfailed; ++i) {
+		if( 0 > fprintf(f, "%d %lld %s\n", cp->failed[i].input, (long long)cp->failed[i].offset, cp->failed[i].pathname) )
+			rc = -1;
+	}
+	if( 0 != fflush(f) )
+		rc = -1;
+#ifndef _WIN32
+	/* журнал должен пережить и сбой системы */
+	if( 0 == rc && 0 != fsync(fileno(f)) )
+		rc = -1;
+#endif
+	if( 0 != fclose(f) )
+		rc = -1;
+
+	if( 0 == rc && 0 != rename(tmp, journal) )
+		rc = -1;
+	if( 0 != rc )
+		remove(tmp);
+
+	free(tmp);
+	return rc;
+}
@@ -0,0 +1,66 @@
+#ifndef __checkpoint_h__
+#define __checkpoint_h__
+
+#include <sys/types.h>
+
+/** Наибольшее число неизвлечённых записей в журнале. */
+#define CHECKPOINT_MAX_FAILED (64)
+
+/** Неизвлечённая запись, пройденная контрольной точкой. */
+struct checkpoint_failed {
+	/* номер входного файла в списке аргументов (начиная с 0) */
+	int input;
+	/* путь_имя этого файла */
+	char *pathname;
+	/* смещение во входном потоке, с которого find_tag() находит запись */
+	off_t offset;
+};
+
+/**
+ * Контрольная точка: граница последней пройденной записи. Записи, которые
+ * до неё не удалось извлечь, перечислены в failed -- --resume повторяет их.
+ */
+struct checkpoint {
+	/* номер входного файла в списке аргументов (начиная с 0) */
+	int input;
+	/* путь_имя этого файла; пустая строка -- файл ещё не начат */
+	char *pathname;
+	/* смещение во входном потоке после закрывающего тэга записи */
+	off_t offset;
+	/* статистика на момент контрольной точки */
+	int found;
+	int extracted;
+	/* неизвлечённые записи (found - extracted) */
+	struct checkpoint_failed failed[ CHECKPOINT_MAX_FAILED ];
+	int nfailed;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	/**
+	 * Функция чтения журнала контрольной точки.
+	 * @param journal путь_имя журнала
+	 * @param cp контрольная точка (путь_имена освобождаются checkpoint_free())
+	 * @return 0 -- успешно; -1 -- журнал не прочитан или испорчен
+	 */
+	int checkpoint_load(const char *journal, struct checkpoint *cp);
+
+	/**
+	 * Процедура освобождения путь_имён прочитанной контрольной точки.
+	 */
+	void checkpoint_free(struct checkpoint *cp);
+
+	/**
+	 * Функция записи журнала контрольной точки. Журнал заменяется
+	 * переименованием временного файла, поэтому при аварийном завершении
+	 * остаётся либо прежняя, либо новая контрольная точка.
+	 * @return 0 -- успешно; -1 -- ошибка (errno)
+	 */
+	int checkpoint_save(const char *journal, const struct checkpoint *cp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__checkpoint_h__*/
@@ -1,7 +1,7 @@
 #include "crc.h"
 
 
-static u_int32_t crcTable[256];
+u_int32_t crc_table[ 256 ];
 
 
 void crc_gen() {
@@ -16,7 +16,7 @@ void crc_gen() {
 			else
 				crc >>= 1;
 		}
-		crcTable[i] = crc;
+		crc_table[i] = crc;
 	}
 }
 
@@ -25,8 +25,8 @@ u_int32_t crc_calc_string(u_int32_t crc, const char * string) {
 
 	crc ^= 0xFFFFFFFF;
 
-	while( '\0' != (c = *string++) ) 
-		crc = (crc >> 8) ^ crcTable[(crc & 0xFF) ^ c];
+	while( '\0' != (c = (unsigned char)*string++) )
+		crc = crc_step(crc, c);
 
 	return crc ^ 0xFFFFFFFF;
 }
@@ -37,8 +37,8 @@ u_int32_t crc_calc_array(u_int32_t crc, const char * array, size_t size) {
 	crc ^= 0xFFFFFFFF;
 
 	while( size-- ) {
-		c = *array++;
-		crc = (crc >> 8) ^ crcTable[(crc & 0xFF) ^ c];
+		c = (unsigned char)*array++;
+		crc = crc_step(crc, c);
 	}
 
 	return (crc ^ 0xFFFFFFFF);
@@ -37,6 +37,17 @@ extern "C" {
 	 */
 	u_int32_t crc_calc_array(u_int32_t crc, const char *array, size_t size);
 
+	/** Таблица для расчёта CRC32 (строится crc_gen()). */
+	extern u_int32_t crc_table[ 256 ];
+
+	/**
+	 * Шаг расчёта CRC32 для одного байта (для встраивания в циклы обработки
+	 * данных). Значение crc -- инвертированное, как внутри crc_calc_array().
+	 */
+	static inline u_int32_t crc_step(u_int32_t crc, unsigned char c) {
+		return (crc >> 8) ^ crc_table[ (crc & 0xFF) ^ c ];
+	}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,785 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include "extrac4.h"
+#include "input.h"
+#include "daemon.h"
+#include "delta.h"
+
+/** Количество цепочек таблицы контейнеров. */
+#define DAEMON_BUCKETS       (4096)
+
+/** Максимальная длина команды. */
+#define DAEMON_MAX_COMMAND   (2 * MAX_PATHNAME + 32)
+
+/** Состояние контрольной суммы записи. */
+enum crc_state {CRC_NONE, CRC_OK, CRC_FAILED};
+
+struct container;
+
+/** Запись в индексе контейнера. */
+struct record {
+	char *path;
+	/* смещение строки открывающего тэга */
+	off_t offset;
+
+	/* разностная запись: база -- предыдущая запись с тем же путь_именем */
+	bool delta;
+	u_int32_t delta_crc;
+
+	/* распакованные данные; NULL -- запись не в кэше */
+	char *data;
+	size_t len;
+	enum crc_state crc;
+	/* контрольная сумма распакованных данных (для поиска базы) */
+	u_int32_t sum;
+
+	/* список LRU */
+	struct record *lru_prev;
+	struct record *lru_next;
+};
+
+/** Индекс контейнера. */
+struct container {
+	char *pathname;
+
+	/* признаки актуальности индекса */
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	long mtime_nsec;
+	off_t size;
+
+	struct record *records;
+	size_t nrecords;
+
+	struct container *next;
+};
+
+/** Соединение клиента. */
+struct client {
+	int fd;
+
+	/* принятая часть команд */
+	char in[ DAEMON_MAX_COMMAND ];
+	size_t in_len;
+
+	/* ещё не отправленные ответы */
+	char *out;
+	size_t out_len;
+	size_t out_pos;
+
+	/* клиент закрыл свою сторону: соединение закрывается после отправки ответов */
+	bool eof;
+	/* остаток слишком длинной команды пропускается до перевода строки */
+	bool skip;
+};
+
+/** Таблица контейнеров. */
+static struct container *containers[ DAEMON_BUCKETS ];
+
+/** Список LRU распакованных записей (голова -- последняя использованная). */
+static struct record *lru_head;
+static struct record *lru_tail;
+static size_t cache_used;
+static size_t cache_limit;
+
+/** Флаг завершения работы. */
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+	(void)sig;
+	stop = 1;
+}
+
+/**
+ * Функция хеширования путь_имени контейнера (FNV-1a).
+ */
+static size_t hash(const char *s) {
+	size_t h = 2166136261u;
+
+	while( '\0' != *s )
+		h = (h ^ (unsigned char)*s++) * 16777619u;
+	return h % DAEMON_BUCKETS;
+}
+
+/**
+ * Процедура исключения записи из списка LRU.
+ */
+static void lru_unlink(struct record *r) {
+	if( NULL != r->lru_prev )
+		r->lru_prev->lru_next = r->lru_next;
+	else
+		lru_head = r->lru_next;
+
+	if( NULL != r->lru_next )
+		r->lru_next->lru_prev = r->lru_prev;
+	else
+		lru_tail = r->lru_prev;
+
+	r->lru_prev = r->lru_next = NULL;
+}
+
+/**
+ * Процедура помещения записи в голову списка LRU.
+ */
+static void lru_push(struct record *r) {
+	r->lru_prev = NULL;
+	r->lru_next = lru_head;
+	if( NULL != lru_head )
+		lru_head->lru_prev = r;
+	lru_head = r;
+	if( NULL == lru_tail )
+		lru_tail = r;
+}
+
+/**
+ * Процедура удаления распакованных данных записи из кэша.
+ */
+static void cache_drop(struct record *r) {
+	if( NULL == r->data )
+		return;
+
+	lru_unlink(r);
+	cache_used -= r->len;
+	free(r->data);
+	r->data = NULL;
+	r->len = 0;
+}
+
+/**
+ * Процедура помещения распакованных данных в кэш с вытеснением
+ * давно не использованных записей.
+ */
+static void cache_put(struct record *r, char *data, size_t len) {
+	r->data = data;
+	r->len = len;
+	cache_used += len;
+	lru_push(r);
+
+	while( cache_used > cache_limit && NULL != lru_tail && lru_tail != r )
+		cache_drop(lru_tail);
+}
+
+/**
+ * Процедура очистки индекса контейнера.
+ */
+static void container_clear(struct container *c) {
+	size_t i;
+
+	for(i = 0; i < c->nrecords; ++i) {
+		cache_drop(&c->records[i]);
+		free(c->records[i].path);
+	}
+
+	free(c->records);
+	c->records = NULL;
+	c->nrecords = 0;
+}
+
+/**
+ * Функция построения индекса контейнера: путь_имена и смещения записей.
+ * @return false -- контейнер не удалось прочитать.
+ */
+static bool container_index(struct container *c) {
+	char line[ MAX_LINESIZE ];
+	size_t cap = 0;
+	FILE *in;
+	bool ok;
+
+	if( NULL == (in = input_open(c->pathname)) )
+		return false;
+
+	in_pathname = c->pathname;
+	in_offset = 0;
+
+	while( 1 ) {
+		off_t offset = in_offset;
+		char *b = find_tag(line, sizeof(line), in);
+
+		if( NULL == b )
+			break;
+
+		init_record();
+		if( parse_tag(b) ) {
+			struct record *r;
+
+			if( c->nrecords == cap ) {
+				cap = cap ? 2 * cap : 16;
+				if( NULL == (r = (struct record*)realloc(c->records, cap * sizeof(*r))) )
+					break;
+				c->records = r;
+			}
+
+			r = &c->records[ c->nrecords ];
+			memset(r, 0, sizeof(*r));
+			r->offset = offset;
+			r->delta = delta_flag;
+			r->delta_crc = delta_crc;
+			if( NULL == (r->path = strdup(out_pathname)) )
+				break;
+			++c->nrecords;
+		}
+
+		/* запись с индексом пропускается без чтения данных */
+		if( !skip_index(line, sizeof(line), in) )
+			skip_record(line, sizeof(line), in);
+	}
+
+	ok = !ferror(in);
+	fclose(in);
+	return ok;
+}
+
+/**
+ * Функция получения актуального индекса контейнера.
+ * Индекс перестраивается (а кэш его записей сбрасывается), если у
+ * контейнера изменились устройство, inode, размер или время модификации.
+ * @return индекс; NULL -- контейнер недоступен.
+ */
+static struct container *container_get(const char *pathname) {
+	struct container **head = &containers[ hash(pathname) ];
+	struct container *c;
+	struct stat st;
+
+	if( -1 == stat(pathname, &st) )
+		return NULL;
+
+	for(c = *head; NULL != c; c = c->next) {
+		if( 0 == strcmp(c->pathname, pathname) )
+			break;
+	}
+
+	if( NULL != c ) {
+		if( c->dev == st.st_dev && c->ino == st.st_ino && c->size == st.st_size
+				&& c->mtime == st.st_mtim.tv_sec && c->mtime_nsec == st.st_mtim.tv_nsec )
+			return c;
+
+		container_clear(c);
+
+	} else {
+		if( NULL == (c = (struct container*)calloc(1, sizeof(*c))) )
+			return NULL;
+		if( NULL == (c->pathname = strdup(pathname)) ) {
+			free(c);
+			return NULL;
+		}
+		c->next = *head;
+		*head = c;
+	}
+
+	c->dev = st.st_dev;
+	c->ino = st.st_ino;
+	c->size = st.st_size;
+	c->mtime = st.st_mtim.tv_sec;
+	c->mtime_nsec = st.st_mtim.tv_nsec;
+
+	if( !container_index(c) ) {
+		container_clear(c);
+		/* при следующем запросе индекс будет построен заново */
+		c->mtime = 0;
+		return NULL;
+	}
+
+	return c;
+}
+
+/**
+ * Функция распаковки записи в память (через кэш).
+ * @return false -- ошибка чтения или распаковки.
+ */
+static bool record_load(struct container *c, struct record *r) {
+	char line[ MAX_LINESIZE ];
+	char *data = NULL;
+	size_t len = 0;
+	FILE *in, *out;
+	FILE *base = NULL;
+	FILE *dout = NULL;
+	char *b;
+	bool ok = false;
+
+	if( NULL != r->data ) {
+		lru_unlink(r);
+		lru_push(r);
+		return true;
+	}
+
+	if( r->delta ) {
+		struct record *p = NULL;
+		size_t i;
+
+		/* база -- ближайшая предыдущая запись с тем же путь_именем и CRC */
+		for(i = r - c->records; i-- > 0; ) {
+			p = &c->records[i];
+			if( 0 == strcmp(p->path, r->path) && record_load(c, p) && p->sum == r->delta_crc )
+				break;
+			p = NULL;
+		}
+		if( NULL == p || NULL == (base = fmemopen(p->data, p->len, "rb")) )
+			return false;
+	}
+
+	if( NULL == (in = input_open(c->pathname)) )
+		return false;
+
+	in_pathname = c->pathname;
+	in_offset = 0;
+
+	/* сжатый поток не позиционируется: пропускаем строки до записи */
+	if( 0 == fseeko(in, r->offset, SEEK_SET) )
+		in_offset = r->offset;
+	else
+		while( in_offset < r->offset && read_line(line, sizeof(line), in) );
+
+	init_record();
+
+	if( NULL != (b = find_tag(line, sizeof(line), in)) && parse_tag(b)
+			&& NULL != (out = open_memstream(&data, &len)) ) {
+		if( NULL == base )
+			ok = unpack_record(line, sizeof(line), in, out);
+		else if( NULL != (dout = delta_open(base, out)) ) {
+			ok = unpack_record(line, sizeof(line), in, dout);
+			if( 0 != fclose(dout) )
+				ok = false;
+		}
+		if( 0 != fclose(out) )
+			ok = false;
+	}
+
+	fclose(in);
+	if( NULL != base )
+		fclose(base);
+
+	if( !ok ) {
+		free(data);
+		return false;
+	}
+
+	r->crc = !crc_check_flag ? CRC_NONE : crc_old_value == crc_value ? CRC_OK : CRC_FAILED;
+	r->sum = crc_calc_array(0, data, len);
+	cache_put(r, data, len);
+	return true;
+}
+
+/**
+ * Функция чтения диапазона записи прямо из контейнера, без распаковки
+ * записи целиком (запись с индексом читается с нужного блока).
+ * @param data на выходе -- выделенный буфер с данными диапазона
+ * @return true -- успешно; false -- ошибка чтения или данных
+ */
+static bool record_range(struct container *c, struct record *r, off_t offset, off_t length, char **data, size_t *len) {
+	char line[ MAX_LINESIZE ];
+	FILE *in, *out;
+	char *b;
+	bool ok = false;
+
+	*data = NULL;
+	*len = 0;
+
+	if( NULL == (in = input_open(c->pathname)) )
+		return false;
+
+	in_pathname = c->pathname;
+	in_offset = 0;
+
+	/* сжатый поток не позиционируется: пропускаем строки до записи */
+	if( 0 == fseeko(in, r->offset, SEEK_SET) )
+		in_offset = r->offset;
+	else
+		while( in_offset < r->offset && read_line(line, sizeof(line), in) );
+
+	init_record();
+
+	if( NULL != (b = find_tag(line, sizeof(line), in)) && parse_tag(b)
+			&& NULL != (out = open_memstream(data, len)) ) {
+		ok = -1 != range_record(line, sizeof(line), in, offset, length, out);
+		if( 0 != fclose(out) )
+			ok = false;
+	}
+
+	fclose(in);
+
+	if( !ok ) {
+		free(*data);
+		*data = NULL;
+	}
+	return ok;
+}
+
+/**
+ * Функция поиска записи по путь_имени (при повторах -- последняя,
+ * как при извлечении в файлы).
+ */
+static struct record *record_find(struct container *c, const char *path) {
+	size_t i;
+
+	for(i = c->nrecords; i-- > 0; ) {
+		if( 0 == strcmp(c->records[i].path, path) )
+			return &c->records[i];
+	}
+	return NULL;
+}
+
+/**
+ * Процедура выполнения одной команды.
+ */
+static void command(char *line, FILE *out) {
+	static const char *crc_names[] = { "no-crc", "ok", "crc-failed" };
+	char *cmd = line;
+	char *pathname = NULL;
+	char *path = NULL;
+	char *range = NULL;
+	struct container *c;
+	struct record *r;
+	size_t i;
+
+	if( NULL != (pathname = strchr(cmd, '\t')) ) {
+		*pathname++ = '\0';
+		if( NULL != (path = strchr(pathname, '\t')) )
+			*path++ = '\0';
+	}
+
+	/* диапазон -- последнее поле команды range */
+	if( NULL != path && 0 == strcmp(cmd, "range") && NULL != (range = strrchr(path, '\t')) )
+		*range++ = '\0';
+
+	if( NULL == pathname || (0 == strcmp(cmd, "extract") || NULL != range) != (NULL != path) ) {
+		fprintf(out, "ERR %s\n", "Incorrect command.");
+		return;
+	}
+
+	if( NULL == (c = container_get(pathname)) ) {
+		fprintf(out, "ERR %s\n", "Can't read container.");
+		return;
+	}
+
+	if( 0 == strcmp(cmd, "list") ) {
+		fprintf(out, "OK %lu\n", (unsigned long)c->nrecords);
+		for(i = 0; i < c->nrecords; ++i)
+			fprintf(out, "%s\n", c->records[i].path);
+
+	} else if( 0 == strcmp(cmd, "check") ) {
+		fprintf(out, "OK %lu\n", (unsigned long)c->nrecords);
+		for(i = 0; i < c->nrecords; ++i) {
+			r = &c->records[i];
+			fprintf(out, "%s\t%s\n", record_load(c, r) ? crc_names[ r->crc ] : "error", r->path);
+		}
+
+	} else if( 0 == strcmp(cmd, "extract") ) {
+		if( NULL == (r = record_find(c, path)) ) {
+			fprintf(out, "ERR %s\n", "No such record.");
+		} else if( !record_load(c, r) ) {
+			fprintf(out, "ERR %s\n", "Can't extract record.");
+		} else if( CRC_FAILED == r->crc ) {
+			fprintf(out, "ERR %s\n", "CRC32 failed.");
+		} else {
+			fprintf(out, "OK %lu\n", (unsigned long)r->len);
+			fwrite(r->data, 1, r->len, out);
+		}
+
+	} else if( NULL != range ) {
+		long long offset, length;
+		char *data;
+		size_t len;
+		int n = 0;
+
+		if( 2 != sscanf(range, "%lld-%lld%n", &offset, &length, &n) || '\0' != range[n] || offset < 0 || length < 0 ) {
+			fprintf(out, "ERR %s\n", "Incorrect command.");
+		} else if( NULL == (r = record_find(c, path)) ) {
+			fprintf(out, "ERR %s\n", "No such record.");
+
+		/* запись в кэше или разностная (нужна база) -- берём из распакованных данных */
+		} else if( NULL != r->data || r->delta ) {
+			if( !record_load(c, r) ) {
+				fprintf(out, "ERR %s\n", "Can't extract record.");
+			} else if( CRC_FAILED == r->crc ) {
+				fprintf(out, "ERR %s\n", "CRC32 failed.");
+			} else {
+				len = (size_t)offset < r->len ? r->len - (size_t)offset : 0;
+				if( (unsigned long long)length < len )
+					len = (size_t)length;
+				fprintf(out, "OK %lu\n", (unsigned long)len);
+				fwrite(r->data + (len ? offset : 0), 1, len, out);
+			}
+
+		} else if( !record_range(c, r, offset, length, &data, &len) ) {
+			fprintf(out, "ERR %s\n", "Can't extract record.");
+		} else {
+			fprintf(out, "OK %lu\n", (unsigned long)len);
+			fwrite(data, 1, len, out);
+			free(data);
+		}
+
+	} else
+		fprintf(out, "ERR %s\n", "Unknown command.");
+}
+
+/**
+ * Функция выполнения полученных от клиента команд: каждая строка --
+ * команда, ответы добавляются к неотправленным.
+ * На слишком длинную команду отвечает ошибкой, её остаток пропускается.
+ * @return false -- нет памяти (соединение закрывается)
+ */
+static bool serve(struct client *cl) {
+	char *data = NULL;
+	size_t len = 0;
+	size_t done = 0;
+	char *eol;
+	FILE *out;
+
+	if( NULL == (out = open_memstream(&data, &len)) )
+		return false;
+
+	while( !stop && NULL != (eol = (char*)memchr(cl->in + done, '\n', cl->in_len - done)) ) {
+		char *line = cl->in + done;
+		char *e = eol;
+
+		done = eol - cl->in + 1;
+		if( cl->skip ) {
+			cl->skip = false;
+			continue;
+		}
+		while( e > line && '\r' == e[-1] )
+			--e;
+		*e = '\0';
+
+		command(line, out);
+	}
+
+	if( 0 == done && sizeof(cl->in) == cl->in_len ) {
+		if( !cl->skip )
+			fprintf(out, "ERR %s\n", "Incorrect command.");
+		done = cl->in_len;
+		cl->skip = true;
+	}
+
+	if( 0 != fclose(out) ) {
+		free(data);
+		return false;
+	}
+
+	memmove(cl->in, cl->in + done, cl->in_len - done);
+	cl->in_len -= done;
+
+	if( 0 == cl->out_len ) {
+		free(cl->out);
+		cl->out = data;
+		cl->out_len = len;
+		cl->out_pos = 0;
+	} else {
+		char *p = (char*)realloc(cl->out, cl->out_len + len);
+
+		if( NULL == p ) {
+			free(data);
+			return false;
+		}
+		memcpy(p + cl->out_len, data, len);
+		cl->out = p;
+		cl->out_len += len;
+		free(data);
+	}
+
+	return true;
+}
+
+/**
+ * Функция приёма данных от клиента.
+ * @return false -- соединение нужно закрыть
+ */
+static bool client_read(struct client *cl) {
+	ssize_t n = read(cl->fd, cl->in + cl->in_len, sizeof(cl->in) - cl->in_len);
+
+	if( -1 == n )
+		return EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno;
+
+	/* последняя команда может быть без перевода строки (буфер никогда не полон) */
+	if( 0 == n ) {
+		cl->eof = true;
+		if( 0 != cl->in_len ) {
+			cl->in[ cl->in_len++ ] = '\n';
+			if( !serve(cl) )
+				return false;
+		}
+		return 0 != cl->out_len;
+	}
+
+	cl->in_len += n;
+	return serve(cl);
+}
+
+/**
+ * Функция отправки ответов клиенту (сколько примет сокет).
+ * @return false -- соединение нужно закрыть
+ */
+static bool client_write(struct client *cl) {
+	while( cl->out_pos < cl->out_len ) {
+		ssize_t n = write(cl->fd, cl->out + cl->out_pos, cl->out_len - cl->out_pos);
+
+		if( -1 == n )
+			return EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno;
+		cl->out_pos += n;
+	}
+
+	free(cl->out);
+	cl->out = NULL;
+	cl->out_len = cl->out_pos = 0;
+
+	return !cl->eof;
+}
+
+/**
+ * Процедура закрытия соединения клиента.
+ */
+static void client_close(struct client *cl) {
+	close(cl->fd);
+	free(cl->out);
+	free(cl);
+}
+
+int daemon_run(const char *socket_path, size_t cache_size) {
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	struct client **clients = NULL;
+	struct pollfd *fds = NULL;
+	size_t nclients = 0;
+	size_t cap = 0;
+	size_t i;
+	int sock;
+
+	cache_limit = cache_size;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if( strlen(socket_path) >= sizeof(addr.sun_path) ) {
+		fprintf(stderr, "%s: %s\n", socket_path, "Socket pathname is too long.");
+		return EXIT_FAILURE;
+	}
+	strcpy(addr.sun_path, socket_path);
+
+	if( -1 == (sock = socket(AF_UNIX, SOCK_STREAM, 0)) ) {
+		fprintf(stderr, "%s: %s\n", socket_path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	unlink(socket_path);
+
+	/* клиент, отключившийся до accept(), не должен остановить цикл */
+	if( -1 == bind(sock, (struct sockaddr*)&addr, sizeof(addr)) || -1 == listen(sock, 64)
+			|| -1 == fcntl(sock, F_SETFL, O_NONBLOCK) ) {
+		fprintf(stderr, "%s: %s\n", socket_path, strerror(errno));
+		close(sock);
+		return EXIT_FAILURE;
+	}
+
+	/* poll() прерывается сигналом завершения */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	if( !(flags & QUIET) )
+		fprintf(stderr, "Listening on '%s'...\n", socket_path);
+
+	/*
+	 * Соединения обслуживаются одним циклом poll(): команды выполняются по
+	 * очереди (разбор использует глобальное состояние), но простаивающий
+	 * или медленно читающий клиент не задерживает остальных.
+	 */
+	while( !stop ) {
+		size_t j;
+
+		if( nclients + 1 > cap ) {
+			struct pollfd *f;
+			struct client **c;
+
+			cap = cap ? 2 * cap : 16;
+			if( NULL == (f = (struct pollfd*)realloc(fds, cap * sizeof(*f))) ) {
+				fprintf(stderr, "%s: %s\n", socket_path, strerror(errno));
+				break;
+			}
+			fds = f;
+			if( NULL == (c = (struct client**)realloc(clients, cap * sizeof(*c))) ) {
+				fprintf(stderr, "%s: %s\n", socket_path, strerror(errno));
+				break;
+			}
+			clients = c;
+		}
+
+		fds[0].fd = sock;
+		fds[0].events = POLLIN;
+		/* пока ответы не отправлены, новые команды клиента не читаются */
+		for(i = 0; i < nclients; ++i) {
+			fds[i + 1].fd = clients[i]->fd;
+			fds[i + 1].events = 0 != clients[i]->out_len ? POLLOUT : POLLIN;
+		}
+
+		if( -1 == poll(fds, nclients + 1, -1) ) {
+			if( EINTR == errno )
+				continue;
+			fprintf(stderr, "%s: %s\n", socket_path, strerror(errno));
+			break;
+		}
+
+		for(i = j = 0; i < nclients; ++i) {
+			struct client *cl = clients[i];
+			bool keep = true;
+
+			if( 0 != (fds[i + 1].revents & (POLLERR | POLLNVAL)) )
+				keep = false;
+			else if( 0 != (fds[i + 1].revents & POLLOUT) )
+				keep = client_write(cl);
+			else if( 0 != (fds[i + 1].revents & (POLLIN | POLLHUP)) )
+				keep = client_read(cl) && (0 == cl->out_len || client_write(cl));
+
+			if( keep )
+				clients[ j++ ] = cl;
+			else
+				client_close(cl);
+		}
+		nclients = j;
+
+		if( 0 != (fds[0].revents & POLLIN) ) {
+			int fd = accept(sock, NULL, NULL);
+			struct client *cl;
+
+			if( -1 == fd ) {
+				if( EINTR == errno || EAGAIN == errno || EWOULDBLOCK == errno || ECONNABORTED == errno )
+					continue;
+				fprintf(stderr, "%s: %s\n", socket_path, strerror(errno));
+				break;
+			}
+
+			if( -1 == fcntl(fd, F_SETFL, O_NONBLOCK) || NULL == (cl = (struct client*)calloc(1, sizeof(*cl))) ) {
+				close(fd);
+				continue;
+			}
+			cl->fd = fd;
+			clients[ nclients++ ] = cl;
+		}
+	}
+
+	for(i = 0; i < nclients; ++i)
+		client_close(clients[i]);
+	free(clients);
+	free(fds);
+
+	close(sock);
+	unlink(socket_path);
+
+	return stop ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,37 @@
+#ifndef __daemon_h__
+#define __daemon_h__
+
+#ifdef __cplusplus
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	/**
+	 * Функция работы в режиме сервера на локальном сокете.
+	 * Сервер принимает по одной команде в строке (поля разделяются табуляцией):
+	 *   list<TAB>контейнер            -- "OK n" и n строк путь_имён записей;
+	 *   check<TAB>контейнер           -- "OK n" и n строк "состояние<TAB>путь_имя";
+	 *   extract<TAB>контейнер<TAB>имя -- "OK размер" и распакованные данные;
+	 *   range<TAB>контейнер<TAB>имя<TAB>смещение-длина -- "OK размер" и
+	 *       диапазон распакованных данных (запись с индексом не
+	 *       распаковывается целиком, контрольная сумма не проверяется).
+	 * При ошибке отвечает строкой "ERR сообщение". Клиентов может быть
+	 * несколько, и каждый может держать соединение открытым: команды всех
+	 * соединений выполняются по очереди одним циклом poll(). Индексы контейнеров и
+	 * распакованные записи хранятся в памяти; индекс перестраивается, если
+	 * у контейнера изменились inode или время модификации.
+	 * @param socket_path путь_имя сокета
+	 * @param cache_size предельный объём кэша распакованных записей (байт)
+	 * @return код завершения программы
+	 */
+	int daemon_run(const char *socket_path, size_t cache_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__daemon_h__*/
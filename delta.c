@@ -0,0 +1,298 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include "delta.h"
+
+/** Команды разностных данных. */
+#define DELTA_COPY           ('c')
+#define DELTA_ADD            ('a')
+
+/** Размер блока, по которому ищутся совпадения с базой. */
+#define DELTA_BLOCK          (32)
+
+/** Множитель скользящего хэша. */
+#define DELTA_PRIME          (0x01000193u)
+
+/** Размер буфера копирования из базы. */
+#define DELTA_BUFSIZE        (64 * 1024)
+
+/** Состояние применения разностных данных. */
+struct delta {
+	FILE *base;
+	FILE *out;
+
+	enum {D_OP, D_OFFSET, D_LENGTH, D_DATA} state;
+	int op;
+	unsigned long long value;
+	unsigned shift;
+	unsigned long long offset;
+	unsigned long long remain;
+};
+
+/**
+ * Функция копирования участка базы в результат.
+ */
+static int delta_copy(struct delta *d, unsigned long long offset, unsigned long long len) {
+	char buf[ DELTA_BUFSIZE ];
+
+	if( 0 != fseeko(d->base, (off_t)offset, SEEK_SET) )
+		return -1;
+
+	while( len > 0 ) {
+		size_t n = len > sizeof(buf) ? sizeof(buf) : (size_t)len;
+
+		if( n != fread(buf, 1, n, d->base) ) {
+			/* ссылка за конец базы */
+			if( !ferror(d->base) )
+				errno = EINVAL;
+			return -1;
+		}
+		if( 1 != fwrite(buf, n, 1, d->out) )
+			return -1;
+		len -= n;
+	}
+	return 0;
+}
+
+/**
+ * Функция разбора разностных данных (интерфейс fopencookie).
+ */
+static ssize_t delta_write(void *cookie, const char *buf, size_t size) {
+	struct delta *d = (struct delta*)cookie;
+	size_t i = 0;
+
+	while( i < size ) {
+		unsigned char c;
+
+		if( D_DATA == d->state ) {
+			size_t n = d->remain < size - i ? (size_t)d->remain : size - i;
+
+			if( 1 != fwrite(buf + i, n, 1, d->out) )
+				return -1;
+			i += n;
+			if( 0 == (d->remain -= n) )
+				d->state = D_OP;
+			continue;
+		}
+
+		c = (unsigned char)buf[i++];
+
+		if( D_OP == d->state ) {
+			if( DELTA_COPY != c && DELTA_ADD != c ) {
+				errno = EINVAL;
+				return -1;
+			}
+			d->op = c;
+			d->state = (DELTA_COPY == c) ? D_OFFSET : D_LENGTH;
+			d->value = 0;
+			d->shift = 0;
+			continue;
+		}
+
+		/* очередные 7 бит числа */
+		if( d->shift > 63 ) {
+			errno = EINVAL;
+			return -1;
+		}
+		d->value |= (unsigned long long)(c & 0x7f) << d->shift;
+		d->shift += 7;
+		if( c & 0x80 )
+			continue;
+
+		if( D_OFFSET == d->state ) {
+			d->offset = d->value;
+			d->state = D_LENGTH;
+			d->value = 0;
+			d->shift = 0;
+
+		} else if( DELTA_COPY == d->op ) {
+			if( 0 != delta_copy(d, d->offset, d->value) )
+				return -1;
+			d->state = D_OP;
+
+		} else {
+			d->remain = d->value;
+			d->state = d->remain ? D_DATA : D_OP;
+		}
+	}
+
+	return size;
+}
+
+/**
+ * Функция завершения разбора (интерфейс fopencookie).
+ */
+static int delta_close(void *cookie) {
+	struct delta *d = (struct delta*)cookie;
+	int rc = (D_OP == d->state) ? 0 : -1;
+
+	free(d);
+	return rc;
+}
+
+FILE *delta_open(FILE *base, FILE *out) {
+	static const cookie_io_functions_t io = { NULL, delta_write, NULL, delta_close };
+	struct delta *d;
+	FILE *f;
+
+	if( NULL == (d = (struct delta*)calloc(1, sizeof(*d))) )
+		return NULL;
+
+	d->base = base;
+	d->out = out;
+	d->state = D_OP;
+
+	if( NULL == (f = fopencookie(d, "wb", io)) )
+		free(d);
+
+	return f;
+}
+
+/**
+ * Функция записи числа в формате LEB128.
+ */
+static int put_number(unsigned long long value, FILE *out) {
+	do {
+		int c = value & 0x7f;
+
+		if( 0 != (value >>= 7) )
+			c |= 0x80;
+		if( EOF == putc(c, out) )
+			return -1;
+	} while( 0 != value );
+	return 0;
+}
+
+/**
+ * Функция записи команды добавления.
+ */
+static int put_add(const char *data, size_t len, FILE *out) {
+	if( 0 == len )
+		return 0;
+	if( EOF == putc(DELTA_ADD, out) || 0 != put_number(len, out) || 1 != fwrite(data, len, 1, out) )
+		return -1;
+	return 0;
+}
+
+/**
+ * Функция записи команды копирования.
+ */
+static int put_copy(size_t offset, size_t len, FILE *out) {
+	if( EOF == putc(DELTA_COPY, out) || 0 != put_number(offset, out) || 0 != put_number(len, out) )
+		return -1;
+	return 0;
+}
+
+/**
+ * Функция расчёта хэша блока.
+ */
+static u_int32_t block_hash(const unsigned char *p) {
+	u_int32_t h = 0;
+	size_t i;
+
+	for(i = 0; i < DELTA_BLOCK; ++i)
+		h = h * DELTA_PRIME + p[i];
+	return h;
+}
+
+int delta_diff(const char *base, size_t base_len, const char *target, size_t target_len, FILE *out) {
+	const unsigned char *b = (const unsigned char*)base;
+	const unsigned char *t = (const unsigned char*)target;
+	size_t nblocks = base_len / DELTA_BLOCK;
+	size_t *table = NULL;
+	size_t mask = 0;
+	size_t lit = 0;
+	size_t i = 0;
+	u_int32_t top = 1;
+	u_int32_t h = 0;
+
+	if( nblocks > 0 ) {
+		size_t size = 1;
+		size_t k;
+
+		while( size < 2 * nblocks )
+			size <<= 1;
+		mask = size - 1;
+
+		/* в таблице хранится смещение блока + 1; 0 -- пусто */
+		if( NULL == (table = (size_t*)calloc(size, sizeof(*table))) )
+			return -1;
+
+		for(k = 0; k < nblocks; ++k) {
+			size_t *slot = &table[ block_hash(b + k * DELTA_BLOCK) & mask ];
+
+			if( 0 == *slot )
+				*slot = k * DELTA_BLOCK + 1;
+		}
+
+		/* множитель уходящего из окна байта */
+		for(k = 1; k < DELTA_BLOCK; ++k)
+			top *= DELTA_PRIME;
+	}
+
+	if( NULL != table && target_len >= DELTA_BLOCK )
+		h = block_hash(t);
+
+	while( NULL != table && i + DELTA_BLOCK <= target_len ) {
+		size_t slot = table[ h & mask ];
+
+		if( 0 != slot && 0 == memcmp(b + slot - 1, t + i, DELTA_BLOCK) ) {
+			size_t o = slot - 1;
+			size_t len = DELTA_BLOCK;
+
+			/* расширяем совпадение в обе стороны */
+			while( i > lit && o > 0 && t[i - 1] == b[o - 1] ) {
+				--i;
+				--o;
+				++len;
+			}
+			while( i + len < target_len && o + len < base_len && t[i + len] == b[o + len] )
+				++len;
+
+			if( 0 != put_add(target + lit, i - lit, out) || 0 != put_copy(o, len, out) ) {
+				free(table);
+				return -1;
+			}
+
+			i += len;
+			lit = i;
+			if( i + DELTA_BLOCK <= target_len )
+				h = block_hash(t + i);
+			continue;
+		}
+
+		/* сдвигаем окно на байт */
+		if( i + DELTA_BLOCK < target_len )
+			h = (h - t[i] * top) * DELTA_PRIME + t[i + DELTA_BLOCK];
+		++i;
+	}
+
+	free(table);
+
+	if( 0 != put_add(target + lit, target_len - lit, out) )
+		return -1;
+
+	return ferror(out) ? -1 : 0;
+}
+
+int delta_base_crc(FILE *base, u_int32_t *crc) {
+	char buf[ DELTA_BUFSIZE ];
+	size_t n;
+
+	*crc = 0;
+
+	if( 0 != fseeko(base, 0, SEEK_SET) )
+		return -1;
+
+	while( 0 != (n = fread(buf, 1, sizeof(buf), base)) )
+		*crc = crc_calc_array(*crc, buf, n);
+
+	return ferror(base) ? -1 : 0;
+}
@@ -0,0 +1,51 @@
+#ifndef __delta_h__
+#define __delta_h__
+
+#ifdef __cplusplus
+#include <cstdio>
+#else
+#include <stdio.h>
+#endif
+
+/* Get u_int32_t. */
+#include "crc.h"
+
+/*
+ * Разностные данные -- последовательность команд:
+ *   'c' смещение длина -- скопировать длина байт базы начиная со смещения;
+ *   'a' длина байты    -- добавить длина байт из самих разностных данных.
+ * Числа записываются в формате LEB128 (по 7 бит, старший бит -- продолжение).
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	/**
+	 * Функция открытия потока применения разностных данных.
+	 * Записанные в поток разностные данные разбираются по мере поступления,
+	 * результат пишется в out. Потоки base и out не закрываются.
+	 * @param base поток базы (позиционируемый)
+	 * @param out поток результата
+	 * @return поток для записи разностных данных; NULL -- ошибка.
+	 *         fclose() возвращает EOF, если данные оборваны посреди команды.
+	 */
+	FILE *delta_open(FILE *base, FILE *out);
+
+	/**
+	 * Функция построения разностных данных target относительно base.
+	 * Совпадения ищутся по хэшам блоков базы (как в rsync).
+	 * @return 0 -- успешно; -1 -- ошибка (errno)
+	 */
+	int delta_diff(const char *base, size_t base_len, const char *target, size_t target_len, FILE *out);
+
+	/**
+	 * Функция расчёта CRC32 всего содержимого потока базы.
+	 * @return 0 -- успешно; -1 -- ошибка чтения
+	 */
+	int delta_base_crc(FILE *base, u_int32_t *crc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__delta_h__*/
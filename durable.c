@@ -0,0 +1,209 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include "durable.h"
+
+#ifdef _WIN32
+
+int durable_temp(const char *pathname, char **tmp) {
+	(void)pathname;
+	(void)tmp;
+	errno = ENOSYS;
+	return -1;
+}
+
+int durable_create(const char *pathname) {
+	(void)pathname;
+	errno = ENOSYS;
+	return -1;
+}
+
+int durable_finish(int keep) {
+	(void)keep;
+	return 0;
+}
+
+int durable_commit() {
+	return 0;
+}
+
+int durable_queued() {
+	return 0;
+}
+
+#else /* _WIN32 */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/** Количество файлов в одной группе фиксации. */
+#define DURABLE_BATCH        (1024)
+
+/** Суффикс шаблона имени временного файла. */
+#define DURABLE_SUFFIX       (".XXXXXX")
+
+/** Файл, ожидающий фиксации. */
+struct pending {
+	char *tmp;
+	char *pathname;
+	dev_t dev;
+};
+
+static struct pending queue[ DURABLE_BATCH ];
+static size_t queued;
+
+/** Текущий (ещё записываемый) временный файл. */
+static struct pending current;
+
+int durable_temp(const char *pathname, char **tmp) {
+	const char *name = strrchr(pathname, '/');
+	mode_t mask;
+	int fd;
+
+	name = (NULL == name) ? pathname : name + 1;
+
+	/* "каталог/.имя.XXXXXX" */
+	if( NULL == (*tmp = (char*)malloc(strlen(pathname) + 2 + sizeof(DURABLE_SUFFIX))) )
+		return -1;
+	memcpy(*tmp, pathname, name - pathname);
+	(*tmp)[ name - pathname ] = '.';
+	strcpy(*tmp + (name - pathname) + 1, name);
+	strcat(*tmp, DURABLE_SUFFIX);
+
+	if( -1 == (fd = mkstemp(*tmp)) ) {
+		free(*tmp);
+		*tmp = NULL;
+		return -1;
+	}
+
+	/* права как у файла, созданного fopen() */
+	mask = umask(0);
+	umask(mask);
+	fchmod(fd, 0666 & ~mask);
+
+	return fd;
+}
+
+int durable_create(const char *pathname) {
+	struct stat st;
+	char *tmp;
+	int fd;
+
+	if( -1 == (fd = durable_temp(pathname, &tmp)) )
+		return -1;
+
+	if( -1 == fstat(fd, &st) || NULL == (current.pathname = strdup(pathname)) ) {
+		close(fd);
+		unlink(tmp);
+		free(tmp);
+		return -1;
+	}
+
+	current.tmp = tmp;
+	current.dev = st.st_dev;
+	return fd;
+}
+
+int durable_finish(int keep) {
+	if( NULL == current.tmp )
+		return 0;
+
+	if( !keep ) {
+		unlink(current.tmp);
+		free(current.tmp);
+		free(current.pathname);
+	} else
+		queue[ queued++ ] = current;
+
+	memset(&current, 0, sizeof(current));
+
+	if( DURABLE_BATCH == queued )
+		return durable_commit();
+	return 0;
+}
+
+/**
+ * Функция сброса на диск всех файловых систем, на которых лежат файлы очереди.
+ */
+static int sync_all() {
+	dev_t done[ DURABLE_BATCH ];
+	size_t ndone = 0;
+	size_t i, j;
+	int rc = 0;
+
+	for(i = 0; i < queued; ++i) {
+		int fd;
+
+		for(j = 0; j < ndone && done[j] != queue[i].dev; ++j);
+		if( j < ndone )
+			continue;
+		done[ ndone++ ] = queue[i].dev;
+
+		/* любой файл годится, чтобы указать файловую систему */
+		if( -1 == (fd = open(NULL != queue[i].tmp ? queue[i].tmp : queue[i].pathname, O_RDONLY)) ) {
+			rc = -1;
+			continue;
+		}
+#ifdef __linux__
+		if( 0 != syncfs(fd) )
+			rc = -1;
+#else
+		sync();
+#endif
+		close(fd);
+	}
+
+	return rc;
+}
+
+int durable_commit() {
+	size_t i;
+	int rc = 0;
+
+	if( 0 == queued )
+		return 0;
+
+	/* данные всех файлов группы */
+	if( 0 != sync_all() ) {
+		fprintf(stderr, "%s\n", "Can't flush extracted files to disk.");
+		rc = -1;
+	}
+
+	for(i = 0; i < queued; ++i) {
+		if( 0 == rc && 0 != rename(queue[i].tmp, queue[i].pathname) ) {
+			fprintf(stderr, "%s: %s\n", queue[i].pathname, strerror(errno));
+			rc = -1;
+		}
+		/* при ошибке временные файлы не оставляем */
+		if( 0 != rc )
+			unlink(queue[i].tmp);
+		free(queue[i].tmp);
+		queue[i].tmp = NULL;
+	}
+
+	/* записи каталогов о переименованных файлах */
+	if( 0 == rc && 0 != sync_all() ) {
+		fprintf(stderr, "%s\n", "Can't flush extracted files to disk.");
+		rc = -1;
+	}
+
+	for(i = 0; i < queued; ++i)
+		free(queue[i].pathname);
+	queued = 0;
+
+	return rc;
+}
+
+int durable_queued() {
+	return (int)queued;
+}
+
+#endif /* _WIN32 */
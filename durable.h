@@ -0,0 +1,49 @@
+#ifndef __durable_h__
+#define __durable_h__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	/**
+	 * Функция создания временного файла ".имя.XXXXXX" рядом с pathname (в том
+	 * же каталоге, а значит, и на той же файловой системе) с правами, как у
+	 * файла, созданного fopen().
+	 * @param tmp путь_имя временного файла (освобождается free())
+	 * @return дескриптор временного файла; -1 -- ошибка (errno)
+	 */
+	int durable_temp(const char *pathname, char **tmp);
+
+	/**
+	 * Функция создания временного файла рядом с pathname для групповой
+	 * фиксации (durable_temp()).
+	 * @return дескриптор временного файла; -1 -- ошибка (errno)
+	 */
+	int durable_create(const char *pathname);
+
+	/**
+	 * Функция завершения временного файла, созданного durable_create().
+	 * Файл ставится в очередь на переименование в pathname; когда очередь
+	 * заполнена, она фиксируется durable_commit().
+	 * @param keep 0 -- файл удаляется (запись не извлечена)
+	 * @return 0 -- успешно; -1 -- ошибка фиксации очереди
+	 */
+	int durable_finish(int keep);
+
+	/**
+	 * Функция групповой фиксации очереди: данные всех файлов сбрасываются
+	 * на диск одним syncfs() на файловую систему, затем файлы переименовываются
+	 * на место и ещё одним syncfs() сбрасываются каталоги.
+	 * @return 0 -- успешно; -1 -- ошибка (сообщение выведено)
+	 */
+	int durable_commit();
+
+	/**
+	 * Функция получения числа файлов, ожидающих фиксации.
+	 */
+	int durable_queued();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__durable_h__*/
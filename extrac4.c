@@ -42,8 +42,28 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
 #include "base64.h"
 #include "crc.h"
+#include "input.h"
+#include "wikixml.h"
+#include "archive.h"
+#include "extrac4.h"
+#include "daemon.h"
+#include "delta.h"
+#include "watch.h"
+#include "checkpoint.h"
+#include "durable.h"
+#include "catalog.h"
+#include "repack.h"
+#include "cache.h"
+#include "progress.h"
+#include "probes.h"
 
 #ifdef _WIN32
 #include <direct.h>
@@ -68,12 +88,26 @@
 #define END2_TAG              ("//<-->")
 #define END2_TAG_LEN          (sizeof(END2_TAG) - 1)
 
-/** Максимальная длинна строки. */
-/** Крайне желательно, чтобы эта величина делилась на 4 (связано с преобразованием base64). */
-#define MAX_LINESIZE         (2048)
+/** Начало блока b64encode (begin-base64 права путь_имя). */
+#define LEGACY_TAG           ("begin-base64 ")
+#define LEGACY_TAG_LEN       (sizeof(LEGACY_TAG) - 1)
+
+/** Конец блока b64encode. */
+#define LEGACY_END_TAG       ("====")
+#define LEGACY_END_TAG_LEN   (sizeof(LEGACY_END_TAG) - 1)
+
+/** Проверка строки на закрывающийся тег (для блока begin-base64 -- на "===="). */
+#define is_end_tag(line)      (legacy_flag ? 0 == strncmp((line), LEGACY_END_TAG, LEGACY_END_TAG_LEN) \
+                                           : (0 == strncmp((line), END_TAG, END_TAG_LEN) || 0 == strncmp((line), END2_TAG, END2_TAG_LEN)))
 
-/** Максимальный размер для строки путь/имя. */
-#define MAX_PATHNAME         (1024)
+/** Длина строки индекса блоков ("!" и 12 шестнадцатеричных цифр). */
+#define INDEX_ENTRY_LEN      (sizeof("!000000000000\n") - 1)
+
+/** Размер буфера распакованных данных записи. */
+#define UNPACK_BUFSIZE       (64 * 1024)
+
+/** Размер блока, который в разреженном файле может стать дырой. */
+#define SPARSE_BLOCK         (4096)
 
 
 /** Имя программы. */
@@ -81,6 +115,18 @@ const char *prog_name;
 
 /** Флаги выполнения. */
 const int QUIET            = 1;
+/** Вход -- XML-выгрузка MediaWiki. */
+const int XML              = 2;
+/** Добавлять заголовок статьи в начало путь_имени. */
+const int XML_TITLES       = 4;
+/** Наблюдать за входными файлами и извлекать изменившиеся записи. */
+const int WATCH            = 8;
+/** Пропускать выровненные блоки из нулей (разреженные файлы). */
+const int SPARSE           = 16;
+/** Продолжить извлечение с контрольной точки. */
+const int RESUME           = 32;
+/** Групповая фиксация извлечённых файлов на диске. */
+const int DURABLE          = 64;
 int flags;
 
 /** Статистика: количество найденных записей. */
@@ -92,11 +138,55 @@ int stat_extracted;
 /** ПутьИмя входного файла. */
 char *in_pathname;
 
+/** Смещение во входном потоке начала следующей строки. */
+off_t in_offset;
+
 /** ПутьИмя выходного файла. */
 char out_pathname[ MAX_PATHNAME + 1 ];
 
 /** Формат текущей записи. */
-enum{TXT, B64} format;
+enum record_format format;
+
+/** Объявленный размер файла (опция !size); -1 -- не задан. */
+off_t out_size;
+
+/** Количество байт, записанных в выходной файл текущей записи. */
+off_t out_written;
+
+/** Отображённый в память выходной файл (если размер объявлен опцией !size). */
+char *out_map;
+size_t out_map_len;
+/** Позиция записи; может превысить out_map_len, если данных больше объявленного. */
+size_t out_map_pos;
+
+/** Выходной файл пишется с дырами на месте блоков из нулей (--sparse). */
+bool out_sparse;
+/** Позиция в разреженном выходном файле и длина ещё не пропущенной дыры. */
+off_t out_pos;
+off_t out_hole;
+
+/** Формат выходного архива; ARCHIVE_NONE -- запись файлов в текущий каталог. */
+enum archive_format archive_format;
+
+/** ПутьИмя выходного архива; NULL -- стандартный вывод. */
+const char *archive_pathname;
+
+/** ПутьИмя сокета сервера; NULL -- обычный режим. */
+const char *daemon_socket;
+
+/** Предельный объём кэша распакованных записей сервера. */
+size_t daemon_cache_size = 64 * 1024 * 1024;
+
+/** ПутьИмя журнала контрольных точек; NULL -- журнал не ведётся. */
+const char *checkpoint_journal;
+/** Интервал между контрольными точками (в записях). */
+int checkpoint_every = 100;
+/** Текущая контрольная точка. */
+struct checkpoint checkpoint;
+/** Контрольная точка дальше не продвигается (ошибка чтения, фиксации или слишком много неизвлечённых записей). */
+bool checkpoint_frozen;
+/** Контрольную точку пора записать (при --durable она ждёт фиксации группы). */
+bool checkpoint_due;
 
 
 /** Флаг проверки контрольной суммы .*/
@@ -107,6 +197,49 @@ u_int32_t crc_old_value;
 /** Новая контрольная сумма. */
 u_int32_t crc_value;
 
+/** Флаг разностной записи. */
+bool delta_flag;
+/** Контрольная сумма базы разностной записи. */
+u_int32_t delta_crc;
+/** Временный файл результата разностной записи (вне --durable); NULL -- нет. */
+static char *delta_tmp;
+
+/** Индекс блоков записи (опция !index=блок@смещение); 0 -- записи без индекса. */
+off_t index_block;
+/** Смещение таблицы индекса от начала данных записи. */
+off_t index_offset;
+
+/** Диапазон для выдачи на стандартный вывод (--range=путь_имя:смещение-длина). */
+const char *range_path;
+off_t range_offset;
+off_t range_length;
+
+/** ПутьИмя каталога записей (--catalog, --update-catalog); NULL -- каталог не используется. */
+const char *catalog_pathname;
+/** Построение (обновление) каталога вместо извлечения. */
+bool catalog_update;
+
+/** Переупаковка контейнеров (--repack) вместо извлечения; --dry-run -- только подсчёт. */
+bool repack_mode;
+bool repack_dry_run;
+
+/** Каталог кэша извлечённых файлов (--output-cache); NULL -- кэш не используется. */
+const char *output_cache;
+/** Предельный объём кэша извлечённых файлов. */
+size_t output_cache_size = 1024 * 1024 * 1024;
+/** Выдавать файлы из кэша жёсткими ссылками. */
+bool output_cache_link;
+
+/** Интервал отчёта о ходе извлечения в секундах (--progress); 0 -- отчёта нет. */
+double progress_interval;
+/** Дескриптор для отчёта строками JSON (--progress-fd); -1 -- текст на stderr. */
+int progress_fd = -1;
+
+/** Текущая запись -- блок begin-base64 (устанавливается find_tag()). */
+bool legacy_flag;
+/** Права доступа из заголовка блока begin-base64; -1 -- не заданы. */
+long out_mode;
+
 
 /** Множество всех символов. */
 #define isall(c) (true)
@@ -122,6 +255,106 @@ u_int32_t crc_value;
 #define ischar(c) (isextra(c) && !isspace(c) && !isspecial(c))
 
 
+/** Функция добавления заголовка статьи в начало out_pathname.
+ * Заголовок становится каталогом верхнего уровня; символы, недопустимые
+ * в имени каталога, заменяются на '_'.
+ * @param title заголовок статьи
+ * @return true -- успешно; false -- путь_имя слишком длинное.
+ */
+bool prefix_title(const char * title) {
+	size_t title_len = strlen(title);
+	size_t path_len = strlen(out_pathname);
+	size_t i;
+
+	if( 0 == title_len )
+		return true;
+
+	if( title_len + 1 + path_len > MAX_PATHNAME ) {
+		if( !(flags & QUIET ) )
+			fprintf(stderr, "%s", "Too longpath pathname field.");
+		else
+			fprintf(stderr, "%s: %s\n", in_pathname, "Incorrect pathname field.");
+		return false;
+	}
+
+	memmove(out_pathname + title_len + 1, out_pathname, path_len + 1);
+
+	for(i = 0; i < title_len; ++i) {
+		char c = title[i];
+
+		if( isspecial(c) || isspace(c) || iseol(c) || (0 == i && '.' == c) )
+			c = '_';
+		out_pathname[i] = c;
+	}
+	out_pathname[ title_len ] = '/';
+
+	return true;
+}
+
+/**
+ * Функция разбора заголовка блока begin-base64: права доступа (восьмеричные)
+ * и путь_имя до конца строки. Ограничения на путь_имя те же, что в тэге.
+ * @param head строка после "begin-base64 "
+ * @return true -- разбор успешен; false -- заголовок содержит ошибку.
+ */
+static bool parse_legacy(char *head) {
+	char *b = head;
+	char *n = out_pathname;
+	char *nmax = out_pathname + sizeof(out_pathname) - 1;
+	char *e;
+
+	while( isspace(*b) ) ++b;
+
+	errno = 0;
+	out_mode = strtol(b, &e, 8);
+
+	if( 0 != errno || e == b || !isspace(*e) || out_mode < 0 || out_mode > 07777 ) {
+		if( !(flags & QUIET ) )
+			fprintf(stderr, "%s", "Incorrect begin-base64 mode");
+		else
+			fprintf(stderr, "%s: %s\n", in_pathname, "Incorrect begin-base64 mode.");
+		return false;
+	}
+
+	for(b = e; isspace(*b); ++b);
+
+	while( true ) {
+		/* пустой компонент или начинающийся с '.' */
+		if( iseol(*b) || '/' == *b || '.' == *b ) {
+			if( !(flags & QUIET ) )
+				fprintf(stderr, "%s", "Incorrect pathname field");
+			else
+				fprintf(stderr, "%s: %s\n", in_pathname, "Incorrect pathname field.");
+			return false;
+		}
+
+		while( !iseol(*b) && '/' != *b && n != nmax )
+			*n++ = *b++;
+
+		if( n == nmax ) {
+			if( !(flags & QUIET ) )
+				fprintf(stderr, "%s", "Too longpath pathname field.");
+			else
+				fprintf(stderr, "%s: %s\n", in_pathname, "Incorrect pathname field.");
+			return false;
+		}
+
+		if( iseol(*b) )
+			break;
+
+		*n++ = *b++;
+	}
+
+	*n = '\0';
+	format = B64;
+
+	/* заголовок статьи XML-выгрузки -- каталог верхнего уровня */
+	if( (flags & XML_TITLES) && !prefix_title(wikixml_title()) )
+		return false;
+
+	return true;
+}
+
 /** Функция выполняет разбора тега.
  * На основе тэга устанавливаются глобальные переменные: out_pathname, ...
  * @param head строка с параметрами открывающегося тэга
@@ -132,6 +365,9 @@ bool parse_tag(char * head) {
 	char * n = NULL;
 	char * nmax = NULL;
 
+	if( legacy_flag )
+		return parse_legacy(head);
+
 	/* проходим ведущие пробелы */
 	while( isspace(*b) ) ++b;
 	/* должно присутствовать путь_имя файла */
@@ -220,6 +456,10 @@ bool parse_tag(char * head) {
 
 	*n = '\0';
 
+	/* заголовок статьи XML-выгрузки -- каталог верхнего уровня */
+	if( (flags & XML_TITLES) && !prefix_title(wikixml_title()) )
+		return false;
+
 	/* пробел перед опциями */
 	while( isspace(*b) ) ++b;
 
@@ -237,6 +477,10 @@ bool parse_tag(char * head) {
 			format = TXT;
 			b += 4;
 
+		} else if( 0 == strncmp("base64url", b, 9) ) {
+			format = B64URL;
+			b += 9;
+
 		} else if( 0 == strncmp("base64", b, 6) ) {
 			format = B64;
 			b += 6;
@@ -244,6 +488,55 @@ bool parse_tag(char * head) {
 		} else if( 0 == strncmp("comment", b, 7) ) {
 			break;
 
+		} else if( 0 == strncmp("size=", b, 5) ) {
+			char *e;
+
+			errno = 0;
+			out_size = strtoll(b + 5, &e, 10);
+
+			if( 0 != errno || e == b + 5 || out_size < 0 ) {
+				if( !(flags & QUIET ) )
+					fprintf(stderr, "%s", "Option size contain incorrect value");
+				else
+					fprintf(stderr, "%s: %s\n", in_pathname, "Incorrect option.");
+				return false;
+			}
+			b = e;
+
+		} else if( 0 == strncmp("index=", b, 6) ) {
+			char *e;
+			char *o = NULL;
+
+			errno = 0;
+			index_block = strtoll(b + 6, &e, 10);
+			if( 0 == errno && '@' == *e )
+				index_offset = strtoll(o = e + 1, &e, 10);
+
+			if( 0 != errno || NULL == o || e == o || index_block <= 0 || 0 != index_block % 3 || index_offset < 0 ) {
+				if( !(flags & QUIET ) )
+					fprintf(stderr, "%s", "Option index contain incorrect value");
+				else
+					fprintf(stderr, "%s: %s\n", in_pathname, "Incorrect option.");
+				return false;
+			}
+			b = e;
+
+		} else if( 0 == strncmp("delta=", b, 6) ) {
+			char *e;
+
+			errno = 0;
+			delta_crc = strtoul(b + 6, &e, 16);
+
+			if( 0 != errno || e == b + 6 ) {
+				if( !(flags & QUIET ) )
+					fprintf(stderr, "%s", "Option delta contain incorrect value");
+				else
+					fprintf(stderr, "%s: %s\n", in_pathname, "Incorrect option.");
+				return false;
+			}
+			delta_flag = true;
+			b = e;
+
 		} else { /* CRC32 */
 			errno = 0;
 			crc_old_value = strtoul(b, &b, 16);
@@ -266,245 +559,1532 @@ bool parse_tag(char * head) {
 }
 
 /**
- * Функция распаковки txt-файлов.
+ * Функция записи в отображённый в память выходной файл.
+ * Данные сверх объявленного размера не записываются, но учитываются в
+ * out_map_pos, чтобы несовпадение размера было обнаружено при закрытии.
  */
-bool unpack_txt(FILE *out, char *line) {
-	return EOF != fputs(line, out);
+bool map_write(const char *data, size_t len) {
+	PROBE2(output__write, out_pathname, len);
+	if( out_map_pos < out_map_len )
+		memcpy(out_map + out_map_pos, data, len < out_map_len - out_map_pos ? len : out_map_len - out_map_pos);
+	out_map_pos += len;
+	return true;
 }
 
 /**
- * Функция распаковки b64-файлов.
+ * Функция создания ветки каталогов выходного файла out_pathname.
+ * @return true -- успешно; false -- ошибка (сообщение выведено).
  */
-bool unpack_b64(FILE *out, char *line) {
-	char outbuf[ MAX_LINESIZE ];
-	size_t outlen = sizeof(outbuf);
-	size_t line_len = strlen(line);
+static bool create_dirs() {
+	char *bp;
 
-	while( iseol( line[line_len - 1] ) ) --line_len;
+	for(bp = out_pathname; NULL != (bp = strchr(bp, '/')); ++bp) {
+		*bp = '\0';
+		if( -1 == mkdir(out_pathname, 0755) && EEXIST != errno )
+			break;
+		*bp = '/';
+	}
 
-	if( false == base64_decode(line, line_len, outbuf, &outlen) ) {
+	/* если не удалось создать ветку каталогов, выводим ошибку */
+	if( NULL != bp ) {
 		if( !(flags & QUIET ) )
-			fprintf(stderr, "%s", ". Incorrect base64 codedata");
+			fprintf(stderr, "%s '%s'", ". Can't create directory", out_pathname);
 		else
-			fprintf(stderr, "%s: %s\n", in_pathname, "Incorrect base64 code.");
+			fprintf(stderr, "%s: %s '%s'.\n", in_pathname, "Can't create directory", out_pathname);
 		return false;
 	}
 
-	return 1 == fwrite(outbuf, outlen, 1, out);
+	return true;
 }
 
 /**
- * Процедура чтения входного файла.
- * Процедура разбирает данные входного файла, выделяет тэги, считывает данные.
- * @param in поток входного файла.
+ * Функция открытия выходного файла out_pathname.
+ * Создаёт ветку каталогов либо, в режиме архива, начинает запись архива.
+ * @return поток для записи содержимого; NULL -- ошибка (сообщение выведено).
  */
-void parse_file(FILE *in) {
-	char b_tmp[ MAX_LINESIZE ];
-
-	while( 1 ) {
-		char * b = NULL;
+FILE *open_output() {
+	FILE *out;
+#ifndef _WIN32
+	int fd = -1;
+#endif
 
-		/* поиск тега начала блока */
-		while( b == NULL && fgets(b_tmp, sizeof(b_tmp), in) ) {
-			if( 0 == strncmp(b_tmp, BEGIN_TAG, BEGIN_TAG_LEN) )
-				b = b_tmp + BEGIN_TAG_LEN;
-			if( 0 == strncmp(b_tmp, BEGIN2_TAG, BEGIN2_TAG_LEN) )
-				b = b_tmp + BEGIN2_TAG_LEN;
+	/* в режиме архива файл записывается в выходной поток */
+	if( ARCHIVE_NONE != archive_format ) {
+		if( !(out = archive_begin(out_pathname, out_size, out_mode)) ) {
+			if( !(flags & QUIET) )
+				fprintf(stderr, "%s", ". Can't write archive entry");
+			else
+				fprintf(stderr, "%s: %s '%s'.\n", in_pathname, "Can't write archive entry", out_pathname);
 		}
+		PROBE3(output__open, out_pathname, (long long)out_size, NULL != out);
+		return out;
+	}
 
-		/* если произошла ошибка или наступил конец файла, завершаем разбор */
-		if( b == NULL )
-			break;
-
-		/* увеличиваем счётчик найденных тегов */
-		++stat_found;
-
-		/* установка параметров по умолчанию */
-		format = TXT;
-		crc_check_flag = false;
-		crc_value = 0;
-		/* приём позволяющий измежать использования goto */
-		/* разбор заголовка */
-		while( parse_tag(b) ) {
-			char *bp;
-			FILE *out;
-
-			if( !(flags & QUIET) )
-				fprintf(stderr, "  Extracting '%s'..", out_pathname);
-			/* создаём ветку каталогов */
-			for(bp = out_pathname; NULL != (bp = strchr(bp, '/')); ++bp) {
-				*bp = '\0';
-				if( -1 == mkdir(out_pathname, 0755) && EEXIST != errno )
-					break;
-				*bp = '/';
+	/* создаём ветку каталогов */
+	if( !create_dirs() )
+		return NULL;
+#ifndef _WIN32
+	/* --durable: файл пишется под временным именем и встаёт на место при фиксации группы */
+	if( (flags & DURABLE) && -1 == (fd = durable_create(out_pathname)) ) {
+		out = NULL;
+	/* результат разностной записи пишется рядом с базой и заменит её после проверок */
+	} else if( delta_flag && !(flags & DURABLE) && -1 == (fd = durable_temp(out_pathname, &delta_tmp)) ) {
+		out = NULL;
+	/* размер известен: резервируем место целиком и распаковываем прямо в память */
+	} else if( out_size > 0 && (off_t)(size_t)out_size == out_size && !delta_flag && !(flags & SPARSE) ) {
+		if( -1 == fd && (-1 != unlink(out_pathname) || ENOENT == errno) )
+			fd = open(out_pathname, O_RDWR | O_CREAT | O_TRUNC, 0666);
+
+		if( -1 != fd ) {
+			void *map = MAP_FAILED;
+
+			if( 0 == posix_fallocate(fd, 0, out_size) )
+				map = mmap(NULL, out_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+			if( MAP_FAILED != map ) {
+				out_map = (char*)map;
+				out_map_len = out_size;
+				out_map_pos = 0;
 			}
 
-			/* если не удалось создать ветку каталогов, выводим ошибку и пропускаем данный тег */
-			if( NULL != bp ) {
-				if( !(flags & QUIET ) )
-					fprintf(stderr, "%s '%s'", ". Can't create directory", out_pathname);
-				else
-					fprintf(stderr, "%s: %s '%s'.\n", in_pathname, "Can't create directory", out_pathname);
-				break;
-			}
-			/* если не удалось создать/открыть файл, выводим ошибку и пропускаем данный тег */
-			if( !(out = fopen(out_pathname, "wb")) ) {
-				if( !(flags & QUIET) )
-					fprintf(stderr, "%s", ". Can't create/open file");
-				else
-					fprintf(stderr, "%s: %s '%s'.\n", in_pathname, "Can't create/open file", out_pathname);
-				break;
+			/* если отображение не удалось, пишем через поток */
+			if( NULL == (out = fdopen(fd, "wb")) ) {
+				if( NULL != out_map )
+					munmap(out_map, out_map_len);
+				out_map = NULL;
+				close(fd);
 			}
-			/* распаковываем содержимое файла */
-			while( fgets(b_tmp, sizeof(b_tmp), in) ) {
-				if( 0 == strncmp(b_tmp, END_TAG, END_TAG_LEN) )
-					break;
-				if( 0 == strncmp(b_tmp, END2_TAG, END2_TAG_LEN) )
-					break;
+		} else
+			out = NULL;
+	} else if( -1 != fd ) {
+		if( NULL == (out = fdopen(fd, "wb")) )
+			close(fd);
+	/* прежний файл может быть жёсткой ссылкой на кэш (--output-cache-link): пишем в новый */
+	} else if( -1 == unlink(out_pathname) && ENOENT != errno ) {
+		out = NULL;
+	} else
+#endif
+	out = fopen(out_pathname, "wb");
 
-				if( TXT == format ) {
-					if( !unpack_txt(out, b_tmp) )
-						break;
-				} else if( B64 == format ) {
-					if( !unpack_b64(out, b_tmp) )
-						break;
-				}
-				if( crc_check_flag )
-					crc_value = crc_calc_string(crc_value, b_tmp);
+	/* если не удалось создать/открыть файл, выводим ошибку */
+	if( !out ) {
+		durable_finish(0);
+		if( !(flags & QUIET) )
+			fprintf(stderr, "%s", ". Can't create/open file");
+		else
+			fprintf(stderr, "%s: %s '%s'.\n", in_pathname, "Can't create/open file", out_pathname);
+	}
+#ifndef _WIN32
+	/* права доступа из заголовка begin-base64 */
+	if( NULL != out && -1 != out_mode && 0 != fchmod(fileno(out), (mode_t)out_mode) ) {
+		if( !(flags & QUIET ) )
+			fprintf(stderr, "%s", ". Can't set file mode");
+		else
+			fprintf(stderr, "%s: %s '%s'.\n", in_pathname, "Can't set file mode", out_pathname);
+		if( NULL != out_map ) {
+			munmap(out_map, out_map_len);
+			out_map = NULL;
+		}
+		fclose(out);
+		durable_finish(0);
+		return NULL;
+	}
 
-			}
-			{
-				/* сохраняем флаг ошибки. */
-				int rec = ferror(out);
+	/* разностные данные пишутся через поток применения, а не в файл */
+	out_sparse = NULL != out && (flags & SPARSE) && !delta_flag;
+	out_pos = 0;
+	out_hole = 0;
+#endif
+	PROBE3(output__open, out_pathname, (long long)out_size, NULL != out);
+	return out;
+}
 
-				fclose(out);
-				/* проверяем флаг ошибки. */
-				if( rec ) {
-					if( !(flags & QUIET) )
-						fprintf(stderr, "%s", ". write error occurred");
-					else
-						fprintf(stderr, "%s: %s '%s'.\n", in_pathname, "Write error occurred during extracting", out_pathname);
-					break;
-				}
-			}
+/**
+ * Процедура остановки контрольной точки: --resume начнёт с последней
+ * записанной. Предупреждение выводится один раз.
+ */
+static void checkpoint_freeze() {
+	if( NULL != checkpoint_journal && !checkpoint_frozen )
+		fprintf(stderr, "%s: %s\n", checkpoint_journal, "Checkpoint stops advancing, --resume will restart from the last one.");
+	checkpoint_frozen = true;
+}
 
-			++stat_extracted;
+/**
+ * Функция открытия базы разностной записи: ранее извлечённого файла
+ * out_pathname с контрольной суммой delta_crc. Результат пишется во
+ * временный файл и заменяет базу только после всех проверок (replace_base()),
+ * поэтому при ошибке база остаётся.
+ * @return поток базы; NULL -- ошибка (сообщение выведено).
+ */
+FILE *open_base() {
+	FILE *base;
+	u_int32_t crc;
 
-			break;
-		}
+	/* база может ещё ждать фиксации под временным именем */
+	if( (flags & DURABLE) && 0 != durable_commit() )
+		checkpoint_freeze();
 
-		/* пропускаем всю оставшуюся информацию до завершающего тэга */
-		/* (необходимо в случае ошибки) */
-		while( 0 != strncmp(b_tmp, END_TAG, END_TAG_LEN) && 0 != strncmp(b_tmp, END2_TAG, END2_TAG_LEN) ) {
-			if( NULL == fgets(b_tmp, sizeof(b_tmp), in) )
-				break;
-		}
+	if( NULL == (base = fopen(out_pathname, "rb")) ) {
+		if( !(flags & QUIET) )
+			fprintf(stderr, "%s", ". Can't open delta base");
+		else
+			fprintf(stderr, "%s: %s '%s'.\n", in_pathname, "Can't open delta base", out_pathname);
+		return NULL;
+	}
 
-		/* если произошла ошибка ввода */
-		if( ferror(in) )
-			break;
+	if( 0 != delta_base_crc(base, &crc) || crc != delta_crc ) {
+		if( !(flags & QUIET) )
+			fprintf(stderr, "%s (%08x != %08x)", ". delta base mismatch", delta_crc, crc);
+		else
+			fprintf(stderr, "%s: %s: %s (%08x != %08x).\n", in_pathname, out_pathname, "Delta base mismatch", delta_crc, crc);
+		fclose(base);
+		return NULL;
+	}
+
+#ifdef _WIN32
+	/* переименование поверх открытого файла невозможно: результат создаётся на месте базы */
+	if( ARCHIVE_NONE == archive_format && 0 != remove(out_pathname) ) {
+		if( !(flags & QUIET) )
+			fprintf(stderr, "%s", ". Can't replace delta base");
+		else
+			fprintf(stderr, "%s: %s '%s'.\n", in_pathname, "Can't replace delta base", out_pathname);
+		fclose(base);
+		return NULL;
+	}
+#endif
 
-		/* проверяем контрольную сумму */
-		if( crc_check_flag ) {
+	return base;
+}
 
-			if( crc_old_value == crc_value ) {
-				if( !(flags & QUIET) )
-					fprintf(stderr, "%s (%08x)", ". CRC32 verified", crc_value);
-			} else {
-				if( !(flags & QUIET) )
-					fprintf(stderr, "%s (%08x != %08x)", ". CRC32 failed", crc_old_value, crc_value);
-				else
-					fprintf(stderr, "%s: %s: %s (%08x != %08x).\n", in_pathname, out_pathname, "CRC32 faild", crc_old_value, crc_value);
-			}
+/**
+ * Функция замены базы разностной записи результатом: временный файл
+ * переименовывается на место базы (при --durable -- ставится в очередь
+ * фиксации), если запись извлечена без ошибок; иначе он удаляется.
+ * @param ok запись извлечена, размер и контрольная сумма сошлись
+ * @return true -- база заменена; false -- база осталась прежней.
+ */
+static bool replace_base(bool ok) {
+	if( (flags & DURABLE) ) {
+		/* ошибка фиксации теряет и файлы прежних записей группы */
+		if( 0 != durable_finish(ok) ) {
+			checkpoint_freeze();
+			return false;
 		}
-		/* завершаем работу с текущим тэгом. */
+		return ok;
+	}
+
+	if( NULL == delta_tmp )
+		return ok;
+
+	if( ok && 0 != rename(delta_tmp, out_pathname) ) {
 		if( !(flags & QUIET) )
-			fprintf(stderr, ".\n");
+			fprintf(stderr, "%s", ". Can't replace delta base");
+		else
+			fprintf(stderr, "%s: %s '%s'.\n", in_pathname, "Can't replace delta base", out_pathname);
+		ok = false;
 	}
+	if( !ok )
+		remove(delta_tmp);
+
+	free(delta_tmp);
+	delta_tmp = NULL;
+	return ok;
 }
 
 /**
- * Процедура печати инструкции.
- * Процедура завершает работу программы.
+ * Функция завершения закрытого выходного файла: в режиме --durable
+ * записанный файл ставится в очередь групповой фиксации, неудачный удаляется.
+ * @param ok файл записан и закрыт без ошибок
  */
-static void usage() {
-	fprintf(stderr, "%s%s%s\n", "Usage: ", prog_name, "[-qv] file1 [file2 ... filen]");
-	exit(EXIT_FAILURE);
+static bool finish_output(bool ok) {
+	/* результат разностной записи завершается после проверки контрольной суммы */
+	if( delta_flag )
+		return ok;
+	if( (flags & DURABLE) && 0 != durable_finish(ok) ) {
+		checkpoint_freeze();
+		ok = false;
+	}
+	return ok;
 }
 
 /**
- * Процедура печати версии программы.
- * Процедура завершает работу программы.
+ * Функция закрытия выходного файла.
+ * Устанавливает out_written; в режиме архива дописывает запись и
+ * проверяет объявленный размер.
+ * @return true -- успешно; false -- ошибка записи.
  */
-static void version() {
-	fprintf(stderr, "%s%s\n", "Extract : ", VERSION_STR);
-	exit(EXIT_FAILURE);
+bool close_output(FILE *out) {
+	bool ok = true;
+
+	if( ARCHIVE_NONE != archive_format ) {
+		out_written = out_size;
+		return 0 == archive_end(out);
+	}
+
+#ifndef _WIN32
+	if( out_sparse ) {
+		out_sparse = false;
+		out_written = out_pos;
+
+		/* файл заканчивается дырой: устанавливаем размер */
+		if( 0 != out_hole && (0 != fflush(out) || 0 != ftruncate(fileno(out), out_pos)) )
+			ok = false;
+
+		return finish_output(0 == fclose(out) && ok);
+	}
+
+	if( NULL != out_map ) {
+		out_written = out_map_pos;
+
+		if( 0 != munmap(out_map, out_map_len) )
+			ok = false;
+		/* данных меньше объявленного: не оставляем хвост из нулей */
+		if( out_map_pos < out_map_len && 0 != ftruncate(fileno(out), out_map_pos) )
+			ok = false;
+
+		out_map = NULL;
+		return finish_output(0 == fclose(out) && ok);
+	}
+#endif
+
+	if( -1 == (out_written = ftello(out)) )
+		ok = false;
+
+	return finish_output(0 == fclose(out) && ok);
 }
 
-int optind;
 /**
- * Процедура разбора параметров командной строки.
- * На основе разбора устанавливается глобальная переменная flags.
- * @param argc количество параметров
- * @param argv список параметров
+ * Функция чтения строки входного файла.
+ * Ведёт счёт смещения in_offset.
+ * @return длина строки; 0 -- конец файла или ошибка чтения.
  */
-static void parse_args(int argc, char **argv) {
-	if( 1 == argc )
-		usage();
+size_t read_line(char *line, size_t size, FILE *in) {
+	size_t len;
 
-	if( 0 == strcmp("-q", argv[1]) ) {
-		flags |= QUIET;
-		optind = 2;
-	} else if( 0 == strcmp("-v", argv[1]) ) {
-		version();
-	} else
-		optind = 1;
+	if( NULL == fgets(line, size, in) )
+		return 0;
+
+	len = strlen(line);
+	in_offset += len;
+	progress_set_input(in_offset);
+	return len;
 }
 
-/** 
- * Начальная функция программы.
+/**
+ * Функция проверки строки на закрывающий тэг текущей записи.
  */
-int main(int argc, char **argv) {
-	int i;
+bool is_end_line(const char *line) {
+	return is_end_tag(line);
+}
 
-	/* запоминаем имя программы */
-	prog_name = argv[0];
+/**
+ * Функция поиска открывающего тэга.
+ * @param line буфер строки
+ * @return параметры тэга внутри line; NULL -- конец файла или ошибка чтения.
+ */
+char *find_tag(char *line, size_t size, FILE *in) {
+	legacy_flag = false;
+
+	while( read_line(line, size, in) ) {
+		if( 0 == strncmp(line, BEGIN_TAG, BEGIN_TAG_LEN) )
+			return line + BEGIN_TAG_LEN;
+		if( 0 == strncmp(line, BEGIN2_TAG, BEGIN2_TAG_LEN) )
+			return line + BEGIN2_TAG_LEN;
+		if( 0 == strncmp(line, LEGACY_TAG, LEGACY_TAG_LEN) ) {
+			legacy_flag = true;
+			return line + LEGACY_TAG_LEN;
+		}
+	}
 
-	parse_args(argc, argv);
+	return NULL;
+}
 
-	crc_gen();
+/**
+ * Процедура установки параметров записи по умолчанию (до разбора тэга).
+ */
+void init_record() {
+	format = TXT;
+	out_size = -1;
+	crc_check_flag = false;
+	crc_value = 0;
+	delta_flag = false;
+	index_block = 0;
+	index_offset = 0;
+	out_mode = -1;
+}
 
-	/* последовательно просматриваем аргументы командной строки */
-	for(i = optind; i < argc; ++i) {
-		FILE *in;
+/**
+ * Функция проверки блока на нули.
+ */
+static bool is_zero(const char *data, size_t len) {
+	return 0 == data[0] && 0 == memcmp(data, data + 1, len - 1);
+}
 
-		in_pathname = argv[i];
-		/* открываем файл */
-		if( 0 == strcmp(in_pathname, "-") ) {
-			in = stdin;
-			in_pathname = "stdin";
+/**
+ * Функция записи распакованных данных в выходной поток.
+ * Для разреженного файла выровненные блоки из нулей не пишутся: позиция
+ * сдвигается перед следующими данными или размер устанавливается при
+ * закрытии, и на их месте остаются дыры.
+ */
+static bool output_write(FILE *out, const char *data, size_t len) {
+	const char *run = data;
 
-		} else if( !(in = fopen(in_pathname, "rb")) ) {
-			fprintf(stderr, "Can't open input file '%s'.\n", in_pathname);
-			continue;
-		}
+	if( 0 == len )
+		return true;
 
-		if( !(flags & QUIET) )
-			fprintf(stderr, "Scanning '%s'...\n", in_pathname);
+	PROBE2(output__write, out_pathname, len);
 
-		parse_file(in);
+	if( !out_sparse )
+		return 1 == fwrite(data, len, 1, out);
 
-		if( ferror(in) )
-			fprintf(stderr, "%s: Read error occurred during parse input file.\n", in_pathname);
+	while( len > 0 ) {
+		size_t n = SPARSE_BLOCK - (size_t)(out_pos % SPARSE_BLOCK);
+
+		if( n > len )
+			n = len;
+
+		if( SPARSE_BLOCK == n && is_zero(data, n) ) {
+			/* дописываем накопленные данные и продлеваем дыру */
+			if( run != data ) {
+				if( 0 != out_hole && 0 != fseeko(out, out_hole, SEEK_CUR) )
+					return false;
+				out_hole = 0;
+				if( 1 != fwrite(run, data - run, 1, out) )
+					return false;
+			}
+			out_hole += n;
+			run = data + n;
+		}
+
+		out_pos += n;
+		data += n;
+		len -= n;
+	}
+
+	if( run != data ) {
+		if( 0 != out_hole && 0 != fseeko(out, out_hole, SEEK_CUR) )
+			return false;
+		out_hole = 0;
+		if( 1 != fwrite(run, data - run, 1, out) )
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Функция распаковки содержимого записи до закрывающего тэга.
+ * Параметры записи берутся из глобальных переменных, установленных
+ * parse_tag(); при необходимости считается контрольная сумма crc_value.
+ * @param line буфер строки; на выходе -- последняя прочитанная строка
+ * @param out поток распакованных данных
+ * @return true -- запись распакована; false -- ошибка распаковки или записи.
+ */
+bool unpack_record(char *line, size_t size, FILE *in, FILE *out) {
+	base64_kernel kernel = base64_kernel_select(TXT != format, B64URL == format ? BASE64_URL : BASE64_STD, crc_check_flag);
+	char buf[ UNPACK_BUFSIZE ];
+	size_t buf_len = 0;
+	size_t batch_lines = 0;
+	size_t batch_bytes = 0;
+	/* байты пакета, раскодированные прямо в отображение (мимо map_write()) */
+	size_t batch_direct = 0;
+	size_t len;
+	bool ok = false;
+
+	while( 0 != (len = read_line(line, size, in)) ) {
+		char *dst;
+		bool direct = false;
+		size_t n;
+
+		/* за данными записи с индексом следует таблица индекса */
+		if( is_end_tag(line) || (0 != index_block && '!' == line[0]) ) {
+			ok = true;
+			break;
+		}
+
+		/* в отображённый в память файл пишем напрямую, если строка там поместится */
+		if( NULL != out_map && 0 == buf_len && out_map_pos <= out_map_len && out_map_len - out_map_pos >= len ) {
+			dst = out_map + out_map_pos;
+			direct = true;
+		} else {
+			if( sizeof(buf) - buf_len < len ) {
+				size_t n = buf_len;
+
+				/* для разреженного файла неполный блок оставляем до следующей записи */
+				if( out_sparse && (size_t)((out_pos + buf_len) % SPARSE_BLOCK) <= buf_len )
+					n -= (size_t)((out_pos + buf_len) % SPARSE_BLOCK);
+
+				if( NULL != out_map )
+					map_write(buf, n);
+				else if( !output_write(out, buf, n) )
+					return false;
+				memmove(buf, buf + n, buf_len - n);
+				buf_len -= n;
+			}
+			dst = buf + buf_len;
+		}
+
+		/* раскодирование, контрольная сумма и запись -- за один проход */
+		if( BASE64_KERNEL_FAIL == (n = kernel(line, len, dst, &crc_value)) ) {
+			if( !(flags & QUIET ) )
+				fprintf(stderr, "%s", ". Incorrect base64 codedata");
+			else
+				fprintf(stderr, "%s: %s\n", in_pathname, "Incorrect base64 code.");
+			break;
+		}
+
+		if( direct ) {
+			out_map_pos += n;
+			batch_direct += n;
+		} else
+			buf_len += n;
+
+		/* пакет раскодирования -- для трассировки */
+		++batch_lines;
+		if( (batch_bytes += n) >= UNPACK_BUFSIZE ) {
+			PROBE3(decode__batch, out_pathname, batch_lines, batch_bytes);
+			if( 0 != batch_direct )
+				PROBE2(output__write, out_pathname, batch_direct);
+			progress_add_output(batch_bytes);
+			batch_lines = 0;
+			batch_bytes = 0;
+			batch_direct = 0;
+		}
+	}
+
+	if( 0 != batch_lines ) {
+		PROBE3(decode__batch, out_pathname, batch_lines, batch_bytes);
+		if( 0 != batch_direct )
+			PROBE2(output__write, out_pathname, batch_direct);
+		progress_add_output(batch_bytes);
+	}
+
+	if( 0 != buf_len ) {
+		if( NULL != out_map )
+			map_write(buf, buf_len);
+		else if( !output_write(out, buf, buf_len) )
+			return false;
+	}
+
+	return ok;
+}
+
+/**
+ * Процедура пропуска оставшейся части записи до закрывающего тэга.
+ * @param line буфер строки с последней прочитанной строкой
+ */
+void skip_record(char *line, size_t size, FILE *in) {
+	while( !is_end_tag(line) ) {
+		if( 0 == read_line(line, size, in) )
+			break;
+	}
+}
+
+/**
+ * Функция пропуска записи с расчётом контрольной суммы её строк без
+ * распаковки (для поиска изменившихся записей).
+ * @param line буфер строки с последней прочитанной строкой (заголовком)
+ * @param crc начальное значение контрольной суммы
+ * @return контрольная сумма строк записи, включая закрывающий тэг
+ */
+u_int32_t hash_record(char *line, size_t size, FILE *in, u_int32_t crc) {
+	while( read_line(line, size, in) ) {
+		crc = crc_calc_string(crc, line);
+		if( is_end_tag(line) )
+			break;
+	}
+	return crc;
+}
+
+/**
+ * Функция пропуска записи с индексом без чтения её данных: конец записи
+ * вычисляется по смещению таблицы индекса и объявленному размеру.
+ * @param line буфер строки с последней прочитанной строкой (заголовком)
+ * @return true -- прочитан закрывающий тэг; false -- запись без индекса,
+ *         поток не позиционируется или индекс не сходится с данными
+ *         (поток возвращён к началу данных)
+ */
+bool skip_index(char *line, size_t size, FILE *in) {
+	off_t data = in_offset;
+	off_t end;
+
+	if( 0 == index_block || -1 == out_size )
+		return false;
+
+	end = data + index_offset + (out_size + index_block - 1) / index_block * (off_t)INDEX_ENTRY_LEN;
+
+	if( 0 != fseeko(in, end, SEEK_SET) )
+		return false;
+	in_offset = end;
+
+	if( read_line(line, size, in) && is_end_tag(line) )
+		return true;
+
+	/* индекс не сходится (например, строки перекодированы): читаем по порядку */
+	line[0] = '\0';
+	if( 0 == fseeko(in, data, SEEK_SET) )
+		in_offset = data;
+	return false;
+}
+
+/**
+ * Функция перехода по индексу к блоку, содержащему смещение offset
+ * распакованных данных.
+ * @param line буфер строки; поток стоит в начале данных записи
+ * @return смещение распакованных данных, с которого продолжится чтение
+ *         (0 -- индекс не используется, поток стоит в начале данных)
+ */
+static off_t index_seek(char *line, size_t size, FILE *in, off_t offset) {
+	off_t data = in_offset;
+	off_t k = offset / index_block;
+	off_t entry;
+	char *e;
+
+	if( 0 == k || 0 != fseeko(in, data + index_offset + k * (off_t)INDEX_ENTRY_LEN, SEEK_SET) )
+		return 0;
+
+	if( read_line(line, size, in) && '!' == line[0] ) {
+		errno = 0;
+		entry = strtoll(line + 1, &e, 16);
+		if( 0 == errno && e != line + 1 && ('\n' == *e || '\r' == *e) && entry > 0 && entry < index_offset
+				&& 0 == fseeko(in, data + entry, SEEK_SET) ) {
+			in_offset = data + entry;
+			return k * index_block;
+		}
+	}
+
+	/* индекс не сходится с данными: читаем с начала */
+	if( 0 != fseeko(in, data, SEEK_SET) )
+		return -1;
+	in_offset = data;
+	return 0;
+}
+
+/**
+ * Функция выдачи диапазона распакованных данных записи, заголовок которой
+ * разобран parse_tag(). Запись с индексом (!index) читается с блока,
+ * содержащего начало диапазона, остальные -- с начала данных.
+ * Контрольная сумма при этом не проверяется.
+ * @param line буфер строки с заголовком записи
+ * @param offset смещение диапазона в распакованных данных
+ * @param length длина диапазона
+ * @param out поток для выдачи данных
+ * @return количество выданных байт (меньше length, если данные кончились);
+ *         -1 -- ошибка (сообщение выведено)
+ */
+off_t range_record(char *line, size_t size, FILE *in, off_t offset, off_t length, FILE *out) {
+	base64_kernel kernel = base64_kernel_select(TXT != format, B64URL == format ? BASE64_URL : BASE64_STD, false);
+	char buf[ MAX_LINESIZE ];
+	off_t pos = 0;
+	off_t written = 0;
+	size_t len;
+
+	if( 0 != index_block && -1 == (pos = index_seek(line, size, in, offset)) ) {
+		fprintf(stderr, "%s: %s\n", in_pathname, "Read error occurred during parse input file.");
+		return -1;
+	}
+
+	while( written < length && 0 != (len = read_line(line, size, in)) ) {
+		size_t n;
+
+		if( is_end_tag(line) || (0 != index_block && '!' == line[0]) )
+			break;
+
+		/* в буфер помещается раскодированная строка: она не длиннее исходной */
+		if( len > sizeof(buf) || BASE64_KERNEL_FAIL == (n = kernel(line, len, buf, NULL)) ) {
+			fprintf(stderr, "%s: %s\n", in_pathname, "Incorrect base64 code.");
+			return -1;
+		}
+
+		if( pos + (off_t)n > offset ) {
+			size_t skip = offset > pos ? (size_t)(offset - pos) : 0;
+			size_t take = n - skip;
+
+			if( (off_t)take > length - written )
+				take = (size_t)(length - written);
+			if( 1 != fwrite(buf + skip, take, 1, out) )
+				return -1;
+			written += take;
+		}
+		pos += n;
+	}
+
+	if( ferror(in) ) {
+		fprintf(stderr, "%s: %s\n", in_pathname, "Read error occurred during parse input file.");
+		return -1;
+	}
+
+	return written;
+}
+
+/**
+ * Функция выдачи записи из кэша извлечённых файлов (--output-cache).
+ * Ключ считается по строкам данных записи; при промахе поток возвращается
+ * к началу данных, и запись распаковывается как обычно.
+ * @param line буфер строки; при попадании -- закрывающий тэг
+ * @return 1 -- файл выдан из кэша; 0 -- промах, ключ рассчитан;
+ *         -1 -- кэш неприменим (поток не позиционируется)
+ */
+static int cache_record(char *line, size_t size, FILE *in, struct cache_key *key) {
+	off_t data = in_offset;
+	size_t len;
+
+	/* сжатый поток не позиционируется: строки данных не перечитать */
+	if( 0 != fseeko(in, data, SEEK_SET) )
+		return -1;
+
+	cache_key_init(key, format, out_size, crc_check_flag, crc_old_value);
+	while( 0 != (len = read_line(line, size, in)) && !is_end_tag(line) )
+		cache_key_update(key, line, len);
+	cache_key_final(key);
+
+	if( 0 != len && create_dirs() && 0 == cache_materialize(key, out_pathname, out_mode) )
+		return 1;
+
+	if( 0 != fseeko(in, data, SEEK_SET) )
+		return -1;
+	in_offset = data;
+
+	return 0;
+}
+
+/**
+ * Процедура извлечения записи, тэг которой найден find_tag().
+ * Разбирает заголовок, распаковывает содержимое, пропускает остаток
+ * записи до закрывающего тэга и проверяет контрольную сумму.
+ * @param b параметры тэга внутри line
+ * @param line буфер строки
+ */
+void extract_record(char *b, char *line, size_t size, FILE *in) {
+	struct cache_key key;
+	bool parsed;
+	bool extracted = false;
+	int cached = -1;
+
+	/* увеличиваем счётчик найденных тегов */
+	++stat_found;
+
+	/* установка параметров по умолчанию */
+	init_record();
+	/* разбор заголовка */
+	PROBE1(tag__begin, b);
+	parsed = parse_tag(b);
+	PROBE4(tag__end, out_pathname, (long long)out_size, (int)format, parsed);
+	if( parsed )
+		progress_record(out_pathname);
+
+	/* приём позволяющий измежать использования goto */
+	while( parsed ) {
+		FILE *out;
+		FILE *base = NULL;
+		FILE *dout;
+
+		if( !(flags & QUIET) )
+			fprintf(stderr, "  Extracting '%s'..", out_pathname);
+		/* запись, извлекавшаяся раньше, выдаётся из кэша без распаковки */
+		if( NULL != output_cache && !delta_flag && 1 == (cached = cache_record(line, size, in, &key)) ) {
+			if( !(flags & QUIET) )
+				fprintf(stderr, "%s", ". Cached");
+			/* в кэш попадают только файлы с верной контрольной суммой */
+			crc_value = crc_old_value;
+			++stat_extracted;
+			break;
+		}
+		/* разностная запись применяется к ранее извлечённому файлу */
+		if( delta_flag && !(base = open_base()) )
+			break;
+		/* если не удалось создать/открыть файл, пропускаем данный тег */
+		if( !(out = open_output()) ) {
+			if( base )
+				fclose(base);
+			break;
+		}
+		if( base && !(dout = delta_open(base, out)) ) {
+			fclose(base);
+			close_output(out);
+			PROBE3(output__close, out_pathname, (long long)out_written, false);
+			if( !(flags & QUIET) )
+				fprintf(stderr, "%s", ". Can't apply delta");
+			else
+				fprintf(stderr, "%s: %s '%s'.\n", in_pathname, "Can't apply delta", out_pathname);
+			break;
+		}
+		if( !base )
+			dout = out;
+		/* распаковываем содержимое файла */
+		unpack_record(line, size, in, dout);
+		{
+			/* сохраняем флаг ошибки. */
+			int rec = ferror(dout);
+
+			if( base ) {
+				/* ошибка разбора разностных данных */
+				if( (0 != fclose(dout) || rec) && !ferror(out) ) {
+					if( !(flags & QUIET) )
+						fprintf(stderr, "%s", ". incorrect delta data");
+					else
+						fprintf(stderr, "%s: %s '%s'.\n", in_pathname, "Incorrect delta data", out_pathname);
+					rec = -1;
+				}
+				fclose(base);
+			}
+			if( !close_output(out) )
+				rec = 1;
+			PROBE3(output__close, out_pathname, (long long)out_written, 0 == rec);
+			/* проверяем флаг ошибки. */
+			if( -1 == rec )
+				break;
+			if( rec ) {
+				if( !(flags & QUIET) )
+					fprintf(stderr, "%s", ". write error occurred");
+				else
+					fprintf(stderr, "%s: %s '%s'.\n", in_pathname, "Write error occurred during extracting", out_pathname);
+				break;
+			}
+		}
+		/* проверяем объявленный размер */
+		if( -1 != out_size && out_written != out_size ) {
+			if( !(flags & QUIET) )
+				fprintf(stderr, "%s (%lld != %lld)", ". size mismatch", (long long)out_size, (long long)out_written);
+			else
+				fprintf(stderr, "%s: %s: %s (%lld != %lld).\n", in_pathname, out_pathname, "Size mismatch", (long long)out_size, (long long)out_written);
+			break;
+		}
+
+		++stat_extracted;
+		extracted = true;
+
+		break;
+	}
+
+	/* пропускаем всю оставшуюся информацию до завершающего тэга */
+	/* (необходимо в случае ошибки) */
+	skip_record(line, size, in);
+	progress_add_record();
+
+	/* если произошла ошибка ввода */
+	if( ferror(in) ) {
+		if( delta_flag )
+			replace_base(false);
+		return;
+	}
+
+	/* проверяем контрольную сумму */
+	if( crc_check_flag ) {
+		PROBE3(crc__result, out_pathname, crc_old_value, crc_value);
+
+		if( crc_old_value == crc_value ) {
+			if( !(flags & QUIET) )
+				fprintf(stderr, "%s (%08x)", ". CRC32 verified", crc_value);
+		} else {
+			if( !(flags & QUIET) )
+				fprintf(stderr, "%s (%08x != %08x)", ". CRC32 failed", crc_old_value, crc_value);
+			else
+				fprintf(stderr, "%s: %s: %s (%08x != %08x).\n", in_pathname, out_pathname, "CRC32 faild", crc_old_value, crc_value);
+		}
+	}
+
+	/* база заменяется результатом, только если он полностью проверен */
+	if( delta_flag && !replace_base(extracted && (!crc_check_flag || crc_old_value == crc_value)) && extracted )
+		--stat_extracted;
+
+	/* промах кэша: извлечённый файл с верной контрольной суммой -- в кэш */
+	if( 0 == cached && extracted && (!crc_check_flag || crc_old_value == crc_value) )
+		cache_insert(&key, out_pathname);
+	/* завершаем работу с текущим тэгом. */
+	if( !(flags & QUIET) )
+		fprintf(stderr, ".\n");
+}
+
+/**
+ * Процедура учёта неизвлечённой записи: контрольная точка продвигается
+ * дальше, а запись заносится в журнал, и --resume повторит её. Если таких
+ * записей больше CHECKPOINT_MAX_FAILED (например, кончилось место),
+ * контрольная точка останавливается.
+ * @param offset смещение, с которого find_tag() находит запись
+ */
+static void checkpoint_fail(int input, char *pathname, off_t offset) {
+	struct checkpoint_failed *failed;
+
+	if( NULL == checkpoint_journal || checkpoint_frozen )
+		return;
+
+	if( CHECKPOINT_MAX_FAILED == checkpoint.nfailed ) {
+		checkpoint_freeze();
+		return;
+	}
+
+	failed = &checkpoint.failed[ checkpoint.nfailed++ ];
+	failed->input = input;
+	failed->pathname = pathname;
+	failed->offset = offset;
+}
+
+/**
+ * Процедура записи контрольной точки в журнал, если её пора записать.
+ * Контрольная точка не должна опережать данные на диске: при --durable она
+ * ждёт, пока очередная группа файлов не будет зафиксирована (очередь пуста),
+ * и не фиксирует группу досрочно.
+ */
+static void checkpoint_commit() {
+	if( checkpoint_frozen || !checkpoint_due || 0 != durable_queued() )
+		return;
+	checkpoint_due = false;
+
+	checkpoint.found = stat_found;
+	checkpoint.extracted = stat_extracted;
+
+	if( 0 != checkpoint_save(checkpoint_journal, &checkpoint) )
+		fprintf(stderr, "%s: %s\n", checkpoint_journal, "Can't write checkpoint.");
+}
+
+/**
+ * Процедура чтения входного файла.
+ * Процедура разбирает данные входного файла, выделяет тэги, считывает данные.
+ * @param in поток входного файла.
+ */
+void parse_file(FILE *in) {
+	char b_tmp[ MAX_LINESIZE ];
+	int extracted;
+
+	while( 1 ) {
+		off_t offset = in_offset;
+		/* поиск тега начала блока */
+		char * b = find_tag(b_tmp, sizeof(b_tmp), in);
+
+		/* если произошла ошибка или наступил конец файла, завершаем разбор */
+		if( b == NULL )
+			break;
+
+		PROBE2(record__begin, in_pathname, (long long)in_offset);
+		extracted = stat_extracted;
+
+		extract_record(b, b_tmp, sizeof(b_tmp), in);
+
+		PROBE4(record__end, in_pathname, (long long)in_offset, out_pathname, extracted != stat_extracted);
+
+		if( extracted == stat_extracted )
+			checkpoint_fail(checkpoint.input, checkpoint.pathname, offset);
+
+		/* если произошла ошибка ввода */
+		if( ferror(in) )
+			break;
+
+		/* граница записи -- очередная контрольная точка */
+		if( NULL != checkpoint_journal && 0 == stat_found % checkpoint_every )
+			checkpoint_due = true;
+		if( checkpoint_due ) {
+			checkpoint.offset = in_offset;
+			checkpoint_commit();
+		}
+	}
+}
+
+/**
+ * Функция открытия входного файла: сжатые данные распаковываются на
+ * лету, из XML-выгрузки извлекаются раскодированные тексты статей.
+ * @return входной поток; NULL -- ошибка (сообщение выведено).
+ */
+FILE *open_input(const char *pathname) {
+	FILE *in;
+
+	if( !(in = input_open(pathname)) ) {
+		fprintf(stderr, "Can't open input file '%s'.\n", pathname);
+		return NULL;
+	}
+
+	if( (flags & XML) ) {
+		FILE *xml = in;
+
+		if( !(in = wikixml_open(xml)) ) {
+			fprintf(stderr, "Can't open input file '%s'.\n", pathname);
+			fclose(xml);
+		}
+	}
+
+	return in;
+}
+
+/**
+ * Функция открытия входного файла на строке offset.
+ * @return входной поток; NULL -- ошибка (сообщение выведено).
+ */
+static FILE *open_input_at(const char *pathname, off_t offset, char *line, size_t size) {
+	FILE *in;
+
+	if( !(in = open_input(in_pathname = (char*)pathname)) )
+		return NULL;
+
+	/* сжатый поток не позиционируется: пропускаем строки до записи */
+	in_offset = 0;
+	if( 0 == fseeko(in, offset, SEEK_SET) )
+		in_offset = offset;
+	else
+		while( in_offset < offset && read_line(line, size, in) );
+
+	return in;
+}
+
+/**
+ * Функция повторного извлечения записей, которые не удалось извлечь до
+ * контрольной точки (--resume); в статистике найденных они уже учтены.
+ * @return 0 -- успешно; -1 -- журнал не соответствует входным файлам
+ */
+static int checkpoint_retry(char **files, int nfiles, const struct checkpoint *resume) {
+	char line[ MAX_LINESIZE ];
+	int i;
+
+	for(i = 0; i < resume->nfailed; ++i) {
+		const struct checkpoint_failed *failed = &resume->failed[i];
+
+		if( failed->input >= nfiles || 0 != strcmp(failed->pathname, files[failed->input]) ) {
+			fprintf(stderr, "Checkpoint '%s' doesn't match input file '%s'.\n", checkpoint_journal, failed->pathname);
+			return -1;
+		}
+	}
+
+	for(i = 0; i < resume->nfailed; ++i) {
+		const struct checkpoint_failed *failed = &resume->failed[i];
+		char *pathname = files[failed->input];
+		int extracted = stat_extracted;
+		FILE *in;
+		char *b;
+
+		/* стандартный ввод не перечитывается */
+		if( 0 != strcmp(pathname, "-") && NULL != (in = open_input_at(pathname, failed->offset, line, sizeof(line))) ) {
+			if( !(flags & QUIET) )
+				fprintf(stderr, "Retrying '%s' at offset %lld...\n", pathname, (long long)failed->offset);
+
+			if( NULL != (b = find_tag(line, sizeof(line), in)) ) {
+				--stat_found;
+				extract_record(b, line, sizeof(line), in);
+			}
+			fclose(in);
+		}
+
+		if( extracted == stat_extracted )
+			checkpoint_fail(failed->input, pathname, failed->offset);
+	}
+
+	return 0;
+}
+
+/**
+ * Функция поиска записи в каталоге (--catalog), nth-й от последней с этим
+ * путь_именем, с проверкой, что контейнер не менялся после построения каталога.
+ * @return 0 -- запись найдена; -1 -- нет (сообщение выведено)
+ */
+static int catalog_lookup(const char *path, u_int64_t nth, struct catalog_entry *entry) {
+	struct stat st;
+
+	if( 0 != catalog_find_nth(path, nth, entry) ) {
+		fprintf(stderr, "%s: %s\n", path, "No such record.");
+		return -1;
+	}
+
+	if( -1 == stat(entry->container, &st) ) {
+		fprintf(stderr, "%s: %s\n", entry->container, strerror(errno));
+		return -1;
+	}
+
+	if( st.st_size != entry->container_size
+			|| st.st_mtim.tv_sec != entry->mtime || st.st_mtim.tv_nsec != entry->mtime_nsec ) {
+		fprintf(stderr, "%s: %s\n", entry->container, "Catalog is out of date.");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Процедура извлечения записей по каталогу (--catalog): контейнер
+ * открывается сразу на строке тэга записи, без просмотра. Разностная
+ * запись применяется к результату предыдущих, поэтому извлекается вся
+ * цепочка с ближайшей предыдущей полной записи с тем же путь_именем (если
+ * её нет, базой служит уже извлечённый файл).
+ */
+static void catalog_extract(char **paths, int npaths) {
+	char line[ MAX_LINESIZE ];
+	struct catalog_entry entry;
+	u_int64_t n;
+	char *b;
+	FILE *in;
+	int i;
+
+	for(i = 0; i < npaths; ++i) {
+		n = 0;
+		if( 0 == catalog_find(paths[i], &entry) )
+			while( entry.delta && 0 == catalog_find_nth(paths[i], n + 1, &entry) )
+				++n;
+
+		do {
+			if( 0 != catalog_lookup(paths[i], n, &entry)
+					|| !(in = open_input_at(entry.container, entry.offset, line, sizeof(line))) ) {
+				++stat_found;
+				continue;
+			}
+
+			if( NULL != (b = find_tag(line, sizeof(line), in)) )
+				extract_record(b, line, sizeof(line), in);
+			else
+				++stat_found;
+
+			if( ferror(in) )
+				fprintf(stderr, "%s: Read error occurred during parse input file.\n", in_pathname);
+			fclose(in);
+		} while( n-- > 0 );
+	}
+}
 
+/**
+ * Функция выдачи диапазона записи range_path на стандартный вывод (--range).
+ * Как и при извлечении в файлы, из записей с одинаковым путь_именем берётся
+ * последняя; записи с индексом при поиске пропускаются без чтения данных.
+ * С каталогом (--catalog) запись ищется в нём, а не просмотром файлов.
+ * @return код завершения программы
+ */
+static int range_run(char **files, int nfiles) {
+	char line[ MAX_LINESIZE ];
+	struct catalog_entry entry;
+	const char *container = NULL;
+	char *b;
+	off_t found_offset = 0;
+	off_t written = -1;
+	FILE *in;
+	int i;
+
+	if( NULL != catalog_pathname ) {
+		if( 0 != catalog_lookup(range_path, 0, &entry) )
+			return EXIT_FAILURE;
+		/* диапазон разностной записи не читается: в ней не данные файла */
+		if( entry.delta ) {
+			fprintf(stderr, "%s: %s '%s'.\n", entry.container, "Can't read range of delta record", range_path);
+			return EXIT_FAILURE;
+		}
+		container = entry.container;
+		found_offset = entry.offset;
+	}
+
+	for(i = 0; NULL == catalog_pathname && i < nfiles; ++i) {
+		if( !(in = open_input(in_pathname = files[i])) )
+			continue;
+
+		in_offset = 0;
+		while( 1 ) {
+			off_t offset = in_offset;
+
+			if( NULL == (b = find_tag(line, sizeof(line), in)) )
+				break;
+
+			init_record();
+			if( parse_tag(b) && 0 == strcmp(out_pathname, range_path) ) {
+				container = files[i];
+				found_offset = offset;
+			}
+
+			if( !skip_index(line, sizeof(line), in) )
+				skip_record(line, sizeof(line), in);
+		}
+
+		if( ferror(in) )
+			fprintf(stderr, "%s: Read error occurred during parse input file.\n", in_pathname);
 		fclose(in);
 	}
 
+	if( NULL == container ) {
+		fprintf(stderr, "%s: %s\n", range_path, "No such record.");
+		return EXIT_FAILURE;
+	}
+
+	if( !(in = open_input_at(container, found_offset, line, sizeof(line))) )
+		return EXIT_FAILURE;
+
+	init_record();
+	if( NULL != (b = find_tag(line, sizeof(line), in)) && parse_tag(b) ) {
+		if( delta_flag )
+			fprintf(stderr, "%s: %s '%s'.\n", in_pathname, "Can't read range of delta record", out_pathname);
+		else
+			written = range_record(line, sizeof(line), in, range_offset, range_length, stdout);
+	}
+	fclose(in);
+
+	if( -1 == written || 0 != fflush(stdout) )
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Процедура печати инструкции.
+ * Процедура завершает работу программы.
+ */
+static void usage() {
+	fprintf(stderr, "%s%s%s\n", "Usage: ", prog_name, " [-qv] [--xml [--xml-titles]] [--sparse] [--durable] [--tar[=FILE] | --cpio[=FILE]] file1 [file2 ... filen]");
+	fprintf(stderr, "%s%s%s\n", "       ", prog_name, " [-qv] [...] --checkpoint=JOURNAL [--checkpoint-every=N] [--resume] file1 [file2 ... filen]");
+	fprintf(stderr, "%s%s%s\n", "       ", prog_name, " [-q] [--xml [--xml-titles]] [--sparse] [--durable] --watch file1 [file2 ... filen]");
+	fprintf(stderr, "%s%s%s\n", "       ", prog_name, " [--xml [--xml-titles]] --range=PATH:OFFSET-LENGTH file1 [file2 ... filen]");
+	fprintf(stderr, "%s%s%s\n", "       ", prog_name, " [-q] [--xml [--xml-titles]] --update-catalog=CATALOG file1 [file2 ... filen]");
+	fprintf(stderr, "%s%s%s\n", "       ", prog_name, " [-qv] [...] --catalog=CATALOG path1 [path2 ... pathn]");
+	fprintf(stderr, "%s%s%s\n", "       ", prog_name, " [--xml [--xml-titles]] --catalog=CATALOG --range=PATH:OFFSET-LENGTH");
+	fprintf(stderr, "%s%s%s\n", "       ", prog_name, " [-qv] [...] --output-cache=DIR [--output-cache-size=BYTES[KMG]] [--output-cache-link] file1 [file2 ... filen]");
+	fprintf(stderr, "%s%s%s\n", "       ", prog_name, " [-qv] [...] --progress[=SECONDS] [--progress-fd=FD] file1 [file2 ... filen]");
+	fprintf(stderr, "%s%s%s\n", "       ", prog_name, " [-q] --repack [--dry-run] file1 [file2 ... filen]");
+	fprintf(stderr, "%s%s%s\n", "       ", prog_name, " [-q] --daemon=SOCKET [--cache-size=BYTES[KMG]]");
+	exit(EXIT_FAILURE);
+}
+
+/**
+ * Процедура печати версии программы.
+ * Процедура завершает работу программы.
+ */
+static void version() {
+	fprintf(stderr, "%s%s\n", "Extract : ", VERSION_STR);
+	exit(EXIT_FAILURE);
+}
+
+int optind;
+/**
+ * Функция разбора объёма в байтах с необязательным суффиксом K, M или G.
+ * @return true -- успешно; false -- неверное значение
+ */
+static bool parse_bytes(const char *s, size_t *value) {
+	char *e;
+
+	*value = strtoul(s, &e, 10);
+	if( 'K' == *e )
+		*value <<= 10, ++e;
+	else if( 'M' == *e )
+		*value <<= 20, ++e;
+	else if( 'G' == *e )
+		*value <<= 30, ++e;
+
+	return e != s && '\0' == *e;
+}
+
+/**
+ * Процедура разбора параметров командной строки.
+ * На основе разбора устанавливается глобальная переменная flags.
+ * @param argc количество параметров
+ * @param argv список параметров
+ */
+static void parse_args(int argc, char **argv) {
+	if( 1 == argc )
+		usage();
+
+	/* "-" -- не опция, а стандартный ввод */
+	for(optind = 1; optind < argc && '-' == argv[optind][0] && '\0' != argv[optind][1]; ++optind) {
+		if( 0 == strcmp("-q", argv[optind]) ) {
+			flags |= QUIET;
+		} else if( 0 == strcmp("-v", argv[optind]) ) {
+			version();
+		} else if( 0 == strcmp("--xml", argv[optind]) ) {
+			flags |= XML;
+		} else if( 0 == strcmp("--xml-titles", argv[optind]) ) {
+			flags |= XML | XML_TITLES;
+		} else if( 0 == strncmp("--checkpoint=", argv[optind], 13) && '\0' != argv[optind][13] ) {
+			checkpoint_journal = argv[optind] + 13;
+		} else if( 0 == strncmp("--checkpoint-every=", argv[optind], 19) ) {
+			char *e;
+
+			checkpoint_every = strtol(argv[optind] + 19, &e, 10);
+			if( e == argv[optind] + 19 || '\0' != *e || checkpoint_every <= 0 )
+				usage();
+		} else if( 0 == strcmp("--durable", argv[optind]) ) {
+			flags |= DURABLE;
+		} else if( 0 == strcmp("--resume", argv[optind]) ) {
+			flags |= RESUME;
+		} else if( 0 == strcmp("--sparse", argv[optind]) ) {
+			flags |= SPARSE;
+		} else if( 0 == strcmp("--watch", argv[optind]) ) {
+			flags |= WATCH;
+		} else if( 0 == strncmp("--tar", argv[optind], 5) && ('\0' == argv[optind][5] || '=' == argv[optind][5]) ) {
+			archive_format = ARCHIVE_TAR;
+			archive_pathname = '=' == argv[optind][5] ? argv[optind] + 6 : NULL;
+		} else if( 0 == strncmp("--cpio", argv[optind], 6) && ('\0' == argv[optind][6] || '=' == argv[optind][6]) ) {
+			archive_format = ARCHIVE_CPIO;
+			archive_pathname = '=' == argv[optind][6] ? argv[optind] + 7 : NULL;
+		} else if( 0 == strncmp("--daemon=", argv[optind], 9) && '\0' != argv[optind][9] ) {
+			daemon_socket = argv[optind] + 9;
+		} else if( 0 == strncmp("--range=", argv[optind], 8) ) {
+			char *colon = strrchr(argv[optind] + 8, ':');
+			char *e;
+
+			if( NULL == colon || colon == argv[optind] + 8 )
+				usage();
+			*colon = '\0';
+			range_path = argv[optind] + 8;
+
+			errno = 0;
+			range_offset = strtoll(colon + 1, &e, 10);
+			if( 0 != errno || e == colon + 1 || '-' != *e || range_offset < 0 )
+				usage();
+			range_length = strtoll(colon = e + 1, &e, 10);
+			if( 0 != errno || e == colon || '\0' != *e || range_length < 0 )
+				usage();
+		} else if( 0 == strncmp("--catalog=", argv[optind], 10) && '\0' != argv[optind][10] ) {
+			catalog_pathname = argv[optind] + 10;
+			catalog_update = false;
+		} else if( 0 == strncmp("--update-catalog=", argv[optind], 17) && '\0' != argv[optind][17] ) {
+			catalog_pathname = argv[optind] + 17;
+			catalog_update = true;
+		} else if( 0 == strcmp("--repack", argv[optind]) ) {
+			repack_mode = true;
+		} else if( 0 == strcmp("--dry-run", argv[optind]) ) {
+			repack_dry_run = true;
+		} else if( 0 == strncmp("--cache-size=", argv[optind], 13) ) {
+			if( !parse_bytes(argv[optind] + 13, &daemon_cache_size) )
+				usage();
+		} else if( 0 == strncmp("--output-cache=", argv[optind], 15) && '\0' != argv[optind][15] ) {
+			output_cache = argv[optind] + 15;
+		} else if( 0 == strncmp("--output-cache-size=", argv[optind], 20) ) {
+			if( !parse_bytes(argv[optind] + 20, &output_cache_size) )
+				usage();
+		} else if( 0 == strcmp("--output-cache-link", argv[optind]) ) {
+			output_cache_link = true;
+		} else if( 0 == strcmp("--progress", argv[optind]) ) {
+			progress_interval = 1;
+		} else if( 0 == strncmp("--progress=", argv[optind], 11) ) {
+			char *e;
+
+			progress_interval = strtod(argv[optind] + 11, &e);
+			if( e == argv[optind] + 11 || '\0' != *e || !(progress_interval > 0) )
+				usage();
+		} else if( 0 == strncmp("--progress-fd=", argv[optind], 14) ) {
+			char *e;
+
+			progress_fd = strtol(argv[optind] + 14, &e, 10);
+			if( e == argv[optind] + 14 || '\0' != *e || progress_fd < 0 )
+				usage();
+		} else
+			usage();
+	}
+
+	/* с каталогом диапазон ищется без входных файлов */
+	if( optind == argc && NULL == daemon_socket && (NULL == catalog_pathname || NULL == range_path) )
+		usage();
+	if( optind != argc && NULL != catalog_pathname && NULL != range_path )
+		usage();
+
+	/* наблюдение -- только за файлами и с записью в каталог */
+	if( (flags & WATCH) && (NULL != daemon_socket || ARCHIVE_NONE != archive_format) )
+		usage();
+
+	/* контрольные точки -- только при записи в каталог; архив пришлось бы начинать заново */
+	if( NULL != checkpoint_journal && (NULL != daemon_socket || (flags & WATCH) || ARCHIVE_NONE != archive_format) )
+		usage();
+	if( (flags & RESUME) && NULL == checkpoint_journal )
+		usage();
+	if( (flags & DURABLE) && (NULL != daemon_socket || ARCHIVE_NONE != archive_format) )
+		usage();
+
+	/* диапазон выдаётся на стандартный вывод: файлы не пишутся */
+	if( NULL != range_path && (NULL != daemon_socket || (flags & (WATCH | SPARSE | DURABLE)) || ARCHIVE_NONE != archive_format || NULL != checkpoint_journal) )
+		usage();
+
+	/* каталог строится отдельным запуском; извлечение по каталогу не просматривает файлы */
+	if( catalog_update && (NULL != daemon_socket || (flags & (WATCH | SPARSE | DURABLE)) || ARCHIVE_NONE != archive_format
+			|| NULL != checkpoint_journal || NULL != range_path) )
+		usage();
+	if( NULL != catalog_pathname && (NULL != daemon_socket || (flags & WATCH) || NULL != checkpoint_journal) )
+		usage();
+
+	/* переупаковка переписывает сами контейнеры: файлы не извлекаются */
+	if( repack_dry_run && !repack_mode )
+		usage();
+
+	/* кэш выдаёт готовые файлы в каталог; режимы без извлечения его не используют */
+	if( output_cache_link && NULL == output_cache )
+		usage();
+
+	/* отчёт о ходе -- только для извлечения, которое когда-нибудь кончается */
+	if( -1 != progress_fd && 0 == progress_interval )
+		progress_interval = 1;
+	if( 0 != progress_interval && (NULL != daemon_socket || (flags & WATCH) || repack_mode || catalog_update || NULL != range_path) )
+		usage();
+	/* строка записи без -q не завершена до конца записи: отчёт в stderr вклинился бы в неё */
+	if( 0 != progress_interval && (-1 == progress_fd || STDERR_FILENO == progress_fd) )
+		flags |= QUIET;
+	if( NULL != output_cache && (NULL != daemon_socket || (flags & DURABLE) || ARCHIVE_NONE != archive_format
+			|| repack_mode || catalog_update || NULL != range_path) )
+		usage();
+	if( repack_mode && (NULL != daemon_socket || (flags & ~QUIET) || ARCHIVE_NONE != archive_format
+			|| NULL != checkpoint_journal || NULL != range_path || NULL != catalog_pathname) )
+		usage();
+}
+
+/** 
+ * Начальная функция программы.
+ */
+int main(int argc, char **argv) {
+	struct checkpoint resume;
+	bool committed;
+	int i;
+
+	memset(&resume, 0, sizeof(resume));
+
+	/* запоминаем имя программы */
+	prog_name = argv[0];
+
+	parse_args(argc, argv);
+
+	crc_gen();
+
+	/* режим сервера: индексы и распакованные записи живут между запросами */
+	if( NULL != daemon_socket )
+		return daemon_run(daemon_socket, daemon_cache_size);
+
+	if( NULL != output_cache && 0 != cache_open(output_cache, (off_t)output_cache_size, output_cache_link) ) {
+		fprintf(stderr, "Can't open output cache '%s'.\n", output_cache);
+		return EXIT_FAILURE;
+	}
+
+	/* режим наблюдения: изменившиеся записи извлекаются заново */
+	if( (flags & WATCH) )
+		return watch_run(argv + optind, argc - optind);
+
+	/* переупаковка контейнеров */
+	if( repack_mode )
+		return repack_run(argv + optind, argc - optind, repack_dry_run);
+
+	/* построение каталога записей */
+	if( catalog_update )
+		return 0 == catalog_build(catalog_pathname, argv + optind, argc - optind) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	if( NULL != catalog_pathname && 0 != catalog_open(catalog_pathname) ) {
+		fprintf(stderr, "Can't read catalog '%s'.\n", catalog_pathname);
+		return EXIT_FAILURE;
+	}
+
+	/* диапазон одной записи на стандартный вывод */
+	if( NULL != range_path ) {
+		flags |= QUIET;
+		return range_run(argv + optind, argc - optind);
+	}
+
+	if( ARCHIVE_NONE != archive_format && 0 != archive_open(archive_format, archive_pathname) ) {
+		fprintf(stderr, "Can't create archive '%s'.\n", archive_pathname);
+		return EXIT_FAILURE;
+	}
+
+	/* продолжаем с контрольной точки: статистика прошлого запуска учитывается */
+	if( (flags & RESUME) ) {
+		if( 0 != checkpoint_load(checkpoint_journal, &resume) ) {
+			fprintf(stderr, "Can't read checkpoint '%s'.\n", checkpoint_journal);
+			return EXIT_FAILURE;
+		}
+		stat_found = resume.found;
+		stat_extracted = resume.extracted;
+	}
+
+	/* отчёт о ходе: текстом на stderr либо строками JSON в заданный дескриптор */
+	if( 0 != progress_interval && 0 != progress_start(-1 == progress_fd ? STDERR_FILENO : progress_fd, -1 != progress_fd,
+			progress_interval, NULL != catalog_pathname ? NULL : argv + optind, argc - optind,
+			NULL != catalog_pathname ? argc - optind : -1) ) {
+		fprintf(stderr, "Can't start progress reporter: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	/* по каталогу записи извлекаются без просмотра контейнеров */
+	if( NULL != catalog_pathname )
+		catalog_extract(argv + optind, argc - optind);
+	else {
+		/* сначала -- записи, которые не удалось извлечь до контрольной точки */
+		if( (flags & RESUME) && 0 != checkpoint_retry(argv + optind, argc - optind, &resume) )
+			return EXIT_FAILURE;
+
+		/* последовательно просматриваем аргументы командной строки */
+		for(i = optind; i < argc; ++i) {
+			FILE *in;
+			off_t offset = 0;
+
+			/* файлы до контрольной точки уже пройдены */
+			if( (flags & RESUME) ) {
+				if( i - optind < resume.input )
+					continue;
+				if( i - optind == resume.input && 0 != resume.offset ) {
+					if( 0 != strcmp(resume.pathname, argv[i]) ) {
+						fprintf(stderr, "Checkpoint '%s' doesn't match input file '%s'.\n", checkpoint_journal, argv[i]);
+						return EXIT_FAILURE;
+					}
+					offset = resume.offset;
+				}
+			}
+
+			checkpoint.input = i - optind;
+			checkpoint.pathname = argv[i];
+
+			in_pathname = argv[i];
+			/* открываем файл (сжатые данные распаковываются на лету) */
+			if( !(in = open_input(in_pathname)) ) {
+				checkpoint_freeze();
+				continue;
+			}
+
+			if( 0 == strcmp(in_pathname, "-") )
+				in_pathname = "stdin";
+
+			in_offset = 0;
+			if( 0 != offset ) {
+				char line[ MAX_LINESIZE ];
+
+				if( !(flags & QUIET) )
+					fprintf(stderr, "Resuming '%s' at offset %lld...\n", in_pathname, (long long)offset);
+				/* сжатый поток не позиционируется: пропускаем строки до записи */
+				if( 0 == fseeko(in, offset, SEEK_SET) )
+					in_offset = offset;
+				else
+					while( in_offset < offset && read_line(line, sizeof(line), in) );
+			} else if( !(flags & QUIET) )
+				fprintf(stderr, "Scanning '%s'...\n", in_pathname);
+
+			if( 0 != progress_interval )
+				progress_file(i - optind, -1 != ftello(in), in_offset);
+
+			parse_file(in);
+
+			if( ferror(in) ) {
+				fprintf(stderr, "%s: Read error occurred during parse input file.\n", in_pathname);
+				checkpoint_freeze();
+			}
+
+			fclose(in);
+
+			/* файл пройден: контрольная точка -- начало следующего */
+			if( NULL != checkpoint_journal ) {
+				checkpoint.input = i - optind + 1;
+				checkpoint.pathname = "";
+				checkpoint.offset = 0;
+				checkpoint_due = true;
+				checkpoint_commit();
+			}
+		}
+	}
+
+	progress_stop();
+
+	/* фиксируем последнюю группу файлов; за ней -- отложенная контрольная точка */
+	if( !(committed = (0 == durable_commit())) )
+		checkpoint_freeze();
+	else
+		checkpoint_commit();
+
+	/* всё извлечено: журнал больше не нужен */
+	if( NULL != checkpoint_journal && !checkpoint_frozen && stat_found == stat_extracted )
+		remove(checkpoint_journal);
+	checkpoint_free(&resume);
+
+	if( ARCHIVE_NONE != archive_format && 0 != archive_close() ) {
+		fprintf(stderr, "%s\n", "Write error occurred during closing archive.");
+		return EXIT_FAILURE;
+	}
+
+	cache_close();
+
 	/* вывод статистики */
 	fprintf(stderr, "There are %d record(s), extracted %d record(s).\n", stat_found, stat_extracted);
 
 	/* обработка статистики */
-	if( stat_extracted == stat_found )
+	if( stat_extracted == stat_found && committed )
 		return EXIT_SUCCESS;
 
 	return EXIT_FAILURE;
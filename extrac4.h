@@ -0,0 +1,130 @@
+#ifndef __extrac4_h__
+#define __extrac4_h__
+
+#include <stdio.h>
+#include <sys/types.h>
+
+/* Get BOOL. */
+#include "base64.h"
+
+/* Get u_int32_t. */
+#include "crc.h"
+
+/** Максимальная длинна строки. */
+/** Крайне желательно, чтобы эта величина делилась на 4 (связано с преобразованием base64). */
+#define MAX_LINESIZE         (2048)
+
+/** Максимальный размер для строки путь/имя. */
+#define MAX_PATHNAME         (1024)
+
+/** Форматы записи. */
+enum record_format {TXT, B64, B64URL};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	/** Флаги выполнения. */
+	extern const int QUIET;
+	extern const int XML;
+	extern const int XML_TITLES;
+	extern int flags;
+
+	/** ПутьИмя входного файла. */
+	extern char *in_pathname;
+
+	/** Смещение во входном потоке начала следующей строки. */
+	extern off_t in_offset;
+
+	/** Параметры текущей записи, устанавливаемые parse_tag(). */
+	extern char out_pathname[ MAX_PATHNAME + 1 ];
+	extern enum record_format format;
+	extern off_t out_size;
+	extern bool crc_check_flag;
+	extern u_int32_t crc_old_value;
+	extern u_int32_t crc_value;
+	extern bool delta_flag;
+	extern u_int32_t delta_crc;
+	extern off_t index_block;
+	extern off_t index_offset;
+
+	/** Текущая запись -- блок begin-base64 ... ==== (устанавливается find_tag()). */
+	extern bool legacy_flag;
+
+	/**
+	 * Функция чтения строки входного файла (ведёт счёт in_offset).
+	 * @return длина строки; 0 -- конец файла или ошибка чтения.
+	 */
+	size_t read_line(char *line, size_t size, FILE *in);
+
+	/**
+	 * Функция проверки строки на закрывающий тэг текущей записи
+	 * (для блока begin-base64 -- на "====").
+	 */
+	bool is_end_line(const char *line);
+
+	/**
+	 * Функция поиска открывающего тэга (или заголовка блока begin-base64).
+	 * @return параметры тэга внутри line; NULL -- конец файла или ошибка чтения.
+	 */
+	char *find_tag(char *line, size_t size, FILE *in);
+
+	/**
+	 * Процедура установки параметров записи по умолчанию (до разбора тэга).
+	 */
+	void init_record();
+
+	/**
+	 * Функция разбора тэга; устанавливает параметры текущей записи.
+	 * @return true -- разбор успешен; false -- заголовок содержит ошибку.
+	 */
+	bool parse_tag(char *head);
+
+	/**
+	 * Функция распаковки содержимого записи до закрывающего тэга.
+	 * @return true -- запись распакована; false -- ошибка распаковки или записи.
+	 */
+	bool unpack_record(char *line, size_t size, FILE *in, FILE *out);
+
+	/**
+	 * Процедура пропуска оставшейся части записи до закрывающего тэга.
+	 */
+	void skip_record(char *line, size_t size, FILE *in);
+
+	/**
+	 * Функция пропуска записи с расчётом контрольной суммы её строк.
+	 * @return контрольная сумма строк записи (начиная со значения crc)
+	 */
+	u_int32_t hash_record(char *line, size_t size, FILE *in, u_int32_t crc);
+
+	/**
+	 * Функция пропуска записи с индексом (!index) без чтения её данных.
+	 * @return true -- запись пропущена; false -- пропуск по индексу
+	 *         невозможен, запись нужно пропустить skip_record()
+	 */
+	bool skip_index(char *line, size_t size, FILE *in);
+
+	/**
+	 * Функция выдачи диапазона распакованных данных записи, заголовок
+	 * которой разобран parse_tag(); запись с индексом читается с блока,
+	 * содержащего начало диапазона.
+	 * @return количество выданных байт; -1 -- ошибка (сообщение выведено)
+	 */
+	off_t range_record(char *line, size_t size, FILE *in, off_t offset, off_t length, FILE *out);
+
+	/**
+	 * Процедура извлечения записи (с выводом сообщений, как при разборе файла).
+	 * @param b параметры тэга, найденного find_tag(), внутри line
+	 */
+	void extract_record(char *b, char *line, size_t size, FILE *in);
+
+	/**
+	 * Функция открытия входного файла с учётом сжатия и режима XML.
+	 * @return входной поток; NULL -- ошибка (сообщение выведено).
+	 */
+	FILE *open_input(const char *pathname);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__extrac4_h__*/
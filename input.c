@@ -0,0 +1,794 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "input.h"
+
+#ifdef _WIN32
+
+FILE *input_open(const char *pathname) {
+	if( 0 == strcmp(pathname, "-") )
+		return stdin;
+	return fopen(pathname, "rb");
+}
+
+#else /* _WIN32 */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/** Количество буферов в очереди распакованных данных. */
+#define INPUT_SLOTS          (16)
+
+/** Размер буфера потоковой распаковки. */
+#define INPUT_CHUNK          (256 * 1024)
+
+/** Желательный объём распакованных данных одного задания параллельной распаковки. */
+#define INPUT_JOB_SIZE       (1024 * 1024)
+
+/** Максимальный размер блока, распаковываемого целиком в память. */
+#define INPUT_MAX_BLOCK      (32 * 1024 * 1024)
+
+/** Максимальное количество потоков распаковки. */
+#define INPUT_MAX_THREADS    (16)
+
+/** Сигнатуры сжатых форматов. */
+#define GZIP_MAGIC           ("\x1f\x8b")
+#define GZIP_MAGIC_LEN       (sizeof(GZIP_MAGIC) - 1)
+#define ZSTD_MAGIC           ("\x28\xb5\x2f\xfd")
+#define ZSTD_MAGIC_LEN       (sizeof(ZSTD_MAGIC) - 1)
+
+/** Буфер очереди распакованных данных. */
+struct slot {
+	enum {SLOT_EMPTY, SLOT_BUSY, SLOT_READY} state;
+	char *data;
+	size_t size;
+	size_t len;
+	size_t pos;
+};
+
+/** Задание параллельной распаковки: последовательность независимых блоков. */
+struct job {
+	const unsigned char *src;
+	size_t src_len;
+	size_t out_len;
+};
+
+struct input;
+
+/**
+ * Функция распаковки очередного задания в буфер очереди.
+ * @return 1 -- данные готовы; 0 -- данные закончились; -1 -- ошибка.
+ */
+typedef int (*input_job)(struct input *in, size_t index, struct slot *slot);
+
+/** Состояние входного потока. */
+struct input {
+	const char *name;
+	int fd;
+
+	/* отображённый в память файл */
+	const unsigned char *map;
+	size_t map_len;
+	size_t map_pos;
+
+	/* байты сигнатуры, прочитанные из неперемещаемого потока */
+	unsigned char head[4];
+	size_t head_len;
+	size_t head_pos;
+
+	/* входной буфер потоковой распаковки */
+	unsigned char *ibuf;
+	const unsigned char *src;
+	size_t src_len;
+	int src_eof;
+	int pending;
+
+	/* задания параллельной распаковки */
+	struct job *jobs;
+	size_t njobs;
+
+#ifdef HAVE_ZLIB
+	z_stream zs;
+	int zs_init;
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_DStream *zds;
+#endif
+
+	input_job job;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t threads[ INPUT_MAX_THREADS ];
+	int nthreads;
+
+	size_t next;
+	size_t consumed;
+	size_t end;
+	int error;
+	int stop;
+
+	struct slot slots[ INPUT_SLOTS ];
+};
+
+/**
+ * Функция чтения с учётом уже прочитанных байтов сигнатуры.
+ */
+static ssize_t input_raw_read(struct input *in, void *buf, size_t size) {
+	ssize_t rec;
+
+	if( in->head_pos < in->head_len ) {
+		rec = in->head_len - in->head_pos;
+		if( (size_t)rec > size )
+			rec = size;
+		memcpy(buf, in->head + in->head_pos, rec);
+		in->head_pos += rec;
+		return rec;
+	}
+
+	do {
+		rec = read(in->fd, buf, size);
+	} while( -1 == rec && EINTR == errno );
+
+	return rec;
+}
+
+/**
+ * Функция получения очередной порции сжатых данных для потоковой распаковки.
+ * Порция остаётся в in->src/in->src_len.
+ * @return 0 -- ошибка чтения.
+ */
+static int input_source(struct input *in) {
+	if( NULL != in->map ) {
+		size_t rest = in->map_len - in->map_pos;
+
+		/* zlib принимает не более UINT_MAX байт за раз */
+		if( rest > (1u << 30) )
+			rest = (1u << 30);
+		in->src = in->map + in->map_pos;
+		in->src_len = rest;
+		in->map_pos += rest;
+		in->src_eof = (in->map_pos == in->map_len);
+		return 1;
+
+	} else {
+		ssize_t rec = input_raw_read(in, in->ibuf, INPUT_CHUNK);
+
+		if( -1 == rec )
+			return 0;
+		in->src = in->ibuf;
+		in->src_len = rec;
+		in->src_eof = (0 == rec);
+		return 1;
+	}
+}
+
+/**
+ * Функция подготовки буфера очереди заданного размера.
+ */
+static int slot_reserve(struct slot *slot, size_t size) {
+	if( slot->size < size || NULL == slot->data ) {
+		char *data = (char*)realloc(slot->data, size ? size : 1);
+
+		if( NULL == data )
+			return 0;
+		slot->data = data;
+		slot->size = size;
+	}
+	slot->len = 0;
+	slot->pos = 0;
+	return 1;
+}
+
+#ifdef HAVE_ZLIB
+
+/**
+ * Потоковая распаковка gzip (в том числе многочленных файлов).
+ */
+static int gzip_stream_job(struct input *in, size_t index, struct slot *slot) {
+	z_stream *zs = &in->zs;
+	int rc;
+
+	(void)index;
+
+	if( !slot_reserve(slot, INPUT_CHUNK) )
+		return -1;
+
+	zs->next_out = (Bytef*)slot->data;
+	zs->avail_out = INPUT_CHUNK;
+
+	while( 0 != zs->avail_out ) {
+		if( 0 == zs->avail_in ) {
+			if( in->src_eof )
+				break;
+			if( !input_source(in) )
+				return -1;
+			zs->next_in = (Bytef*)in->src;
+			zs->avail_in = in->src_len;
+			if( 0 == zs->avail_in )
+				break;
+		}
+
+		in->pending = 1;
+		rc = inflate(zs, Z_NO_FLUSH);
+
+		if( Z_STREAM_END == rc ) {
+			/* следующий член многочленного файла */
+			in->pending = 0;
+			inflateReset(zs);
+			continue;
+		}
+
+		if( Z_OK != rc && Z_BUF_ERROR != rc ) {
+			fprintf(stderr, "%s: %s\n", in->name, "Incorrect gzip data.");
+			return -1;
+		}
+	}
+
+	slot->len = INPUT_CHUNK - zs->avail_out;
+
+	if( 0 == slot->len && in->pending ) {
+		fprintf(stderr, "%s: %s\n", in->name, "Unexpected end of gzip data.");
+		return -1;
+	}
+
+	return 0 == slot->len ? 0 : 1;
+}
+
+/**
+ * Распаковка задания из последовательности членов gzip известного размера.
+ */
+static int gzip_block_job(struct input *in, size_t index, struct slot *slot) {
+	const struct job *job;
+	z_stream zs;
+	int rc;
+
+	if( index >= in->njobs )
+		return 0;
+
+	job = &in->jobs[ index ];
+
+	if( !slot_reserve(slot, job->out_len) )
+		return -1;
+
+	memset(&zs, 0, sizeof(zs));
+	if( Z_OK != inflateInit2(&zs, 16 + MAX_WBITS) )
+		return -1;
+
+	zs.next_in = (Bytef*)job->src;
+	zs.avail_in = job->src_len;
+	zs.next_out = (Bytef*)slot->data;
+	zs.avail_out = job->out_len;
+
+	do {
+		rc = inflate(&zs, Z_FINISH);
+		if( Z_STREAM_END == rc && 0 != zs.avail_in )
+			inflateReset(&zs);
+	} while( Z_STREAM_END == rc && 0 != zs.avail_in );
+
+	inflateEnd(&zs);
+
+	if( Z_STREAM_END != rc || 0 != zs.avail_out ) {
+		fprintf(stderr, "%s: %s\n", in->name, "Incorrect gzip data.");
+		return -1;
+	}
+
+	slot->len = job->out_len;
+	return 1;
+}
+
+/**
+ * Функция разбора gzip-файла на блоки BGZF (член с подполем 'BC' содержит свой размер).
+ * @return 0 -- файл не состоит из блоков BGZF.
+ */
+static int gzip_split(struct input *in) {
+	const unsigned char *p = in->map;
+	const unsigned char *pmax = in->map + in->map_len;
+	size_t cap = 0;
+
+	while( p < pmax ) {
+		const unsigned char *x, *xmax;
+		size_t bsize = 0;
+		size_t isize;
+
+		/* ID1 ID2 CM FLG(FEXTRA) MTIME(4) XFL OS XLEN(2) */
+		if( pmax - p < 12 + 8 || 0x1f != p[0] || 0x8b != p[1] || 8 != p[2] || !(p[3] & 4) )
+			return 0;
+
+		x = p + 12;
+		xmax = x + (p[10] | (p[11] << 8));
+		if( xmax > pmax )
+			return 0;
+
+		for( ; x + 4 <= xmax; x += 4 + (x[2] | (x[3] << 8)) ) {
+			if( 'B' == x[0] && 'C' == x[1] && 2 == (x[2] | (x[3] << 8)) && x + 6 <= xmax )
+				bsize = (x[4] | (x[5] << 8)) + 1;
+		}
+
+		if( 0 == bsize || bsize > (size_t)(pmax - p) )
+			return 0;
+
+		isize = p[bsize - 4] | (p[bsize - 3] << 8) | (p[bsize - 2] << 16) | ((size_t)p[bsize - 1] << 24);
+
+		/* объединяем маленькие блоки в одно задание */
+		if( 0 == in->njobs || in->jobs[ in->njobs - 1 ].out_len >= INPUT_JOB_SIZE ) {
+			if( in->njobs == cap ) {
+				struct job *jobs;
+
+				cap = cap ? 2 * cap : 64;
+				if( NULL == (jobs = (struct job*)realloc(in->jobs, cap * sizeof(*jobs))) )
+					return 0;
+				in->jobs = jobs;
+			}
+			in->jobs[ in->njobs ].src = p;
+			in->jobs[ in->njobs ].src_len = 0;
+			in->jobs[ in->njobs ].out_len = 0;
+			++in->njobs;
+		}
+
+		in->jobs[ in->njobs - 1 ].src_len += bsize;
+		in->jobs[ in->njobs - 1 ].out_len += isize;
+		p += bsize;
+	}
+
+	return 1;
+}
+
+#endif /* HAVE_ZLIB */
+
+#ifdef HAVE_ZSTD
+
+/**
+ * Потоковая распаковка zstd.
+ */
+static int zstd_stream_job(struct input *in, size_t index, struct slot *slot) {
+	ZSTD_outBuffer out;
+	ZSTD_inBuffer src;
+	size_t rc;
+
+	(void)index;
+
+	if( !slot_reserve(slot, INPUT_CHUNK) )
+		return -1;
+
+	out.dst = slot->data;
+	out.size = INPUT_CHUNK;
+	out.pos = 0;
+
+	while( out.pos < out.size ) {
+		size_t before = out.pos;
+
+		if( 0 == in->src_len && !in->src_eof && !input_source(in) )
+			return -1;
+
+		/* вход кончился, но zstd может ещё держать распакованные данные */
+		if( 0 == in->src_len && !in->pending )
+			break;
+
+		src.src = in->src;
+		src.size = in->src_len;
+		src.pos = 0;
+
+		rc = ZSTD_decompressStream(in->zds, &out, &src);
+
+		in->src += src.pos;
+		in->src_len -= src.pos;
+
+		if( ZSTD_isError(rc) ) {
+			fprintf(stderr, "%s: %s\n", in->name, "Incorrect zstd data.");
+			return -1;
+		}
+
+		/* незавершённый кадр */
+		in->pending = (0 != rc);
+
+		/* данные оборваны посреди кадра: выдавать больше нечего */
+		if( 0 == src.pos && out.pos == before && 0 == in->src_len && in->src_eof )
+			break;
+	}
+
+	slot->len = out.pos;
+
+	if( 0 == slot->len && in->pending ) {
+		fprintf(stderr, "%s: %s\n", in->name, "Unexpected end of zstd data.");
+		return -1;
+	}
+
+	return 0 == slot->len ? 0 : 1;
+}
+
+/**
+ * Распаковка задания из последовательности кадров zstd известного размера.
+ */
+static int zstd_block_job(struct input *in, size_t index, struct slot *slot) {
+	const struct job *job;
+	size_t rc;
+
+	if( index >= in->njobs )
+		return 0;
+
+	job = &in->jobs[ index ];
+
+	if( !slot_reserve(slot, job->out_len) )
+		return -1;
+
+	rc = ZSTD_decompress(slot->data, job->out_len, job->src, job->src_len);
+
+	if( ZSTD_isError(rc) || rc != job->out_len ) {
+		fprintf(stderr, "%s: %s\n", in->name, "Incorrect zstd data.");
+		return -1;
+	}
+
+	slot->len = job->out_len;
+	return 1;
+}
+
+/**
+ * Функция разбора zstd-файла на кадры с известным размером распакованных данных.
+ * @return 0 -- размер какого-либо кадра неизвестен или слишком велик.
+ */
+static int zstd_split(struct input *in) {
+	const unsigned char *p = in->map;
+	const unsigned char *pmax = in->map + in->map_len;
+	size_t cap = 0;
+
+	while( p < pmax ) {
+		size_t csize = ZSTD_findFrameCompressedSize(p, pmax - p);
+		unsigned long long dsize = ZSTD_getFrameContentSize(p, pmax - p);
+
+		if( ZSTD_isError(csize) || ZSTD_CONTENTSIZE_UNKNOWN == dsize || ZSTD_CONTENTSIZE_ERROR == dsize || dsize > INPUT_MAX_BLOCK )
+			return 0;
+
+		if( 0 == in->njobs || in->jobs[ in->njobs - 1 ].out_len >= INPUT_JOB_SIZE
+				|| in->jobs[ in->njobs - 1 ].out_len + dsize > INPUT_MAX_BLOCK ) {
+			if( in->njobs == cap ) {
+				struct job *jobs;
+
+				cap = cap ? 2 * cap : 64;
+				if( NULL == (jobs = (struct job*)realloc(in->jobs, cap * sizeof(*jobs))) )
+					return 0;
+				in->jobs = jobs;
+			}
+			in->jobs[ in->njobs ].src = p;
+			in->jobs[ in->njobs ].src_len = 0;
+			in->jobs[ in->njobs ].out_len = 0;
+			++in->njobs;
+		}
+
+		in->jobs[ in->njobs - 1 ].src_len += csize;
+		in->jobs[ in->njobs - 1 ].out_len += dsize;
+		p += csize;
+	}
+
+	return 1;
+}
+
+#endif /* HAVE_ZSTD */
+
+/**
+ * Поток распаковки: забирает очередное задание и кладёт результат в очередь.
+ */
+static void *input_worker(void *arg) {
+	struct input *in = (struct input*)arg;
+
+	pthread_mutex_lock(&in->lock);
+
+	while( !in->stop && in->next < in->end ) {
+		struct slot *slot;
+		size_t index;
+		int rc;
+
+		/* ждём освобождения буфера */
+		if( in->next >= in->consumed + INPUT_SLOTS ) {
+			pthread_cond_wait(&in->cond, &in->lock);
+			continue;
+		}
+
+		index = in->next++;
+		slot = &in->slots[ index % INPUT_SLOTS ];
+		slot->state = SLOT_BUSY;
+
+		pthread_mutex_unlock(&in->lock);
+		rc = in->job(in, index, slot);
+		pthread_mutex_lock(&in->lock);
+
+		if( 1 == rc ) {
+			slot->state = SLOT_READY;
+		} else {
+			slot->state = SLOT_EMPTY;
+			if( -1 == rc )
+				in->error = 1;
+			if( index < in->end )
+				in->end = index;
+		}
+
+		pthread_cond_broadcast(&in->cond);
+	}
+
+	pthread_mutex_unlock(&in->lock);
+	return NULL;
+}
+
+/**
+ * Функция чтения распакованных данных (интерфейс fopencookie).
+ */
+static ssize_t input_read(void *cookie, char *buf, size_t size) {
+	struct input *in = (struct input*)cookie;
+	size_t done = 0;
+
+	/* несжатые данные из неперемещаемого потока */
+	if( NULL == in->job )
+		return input_raw_read(in, buf, size);
+
+	while( done < size ) {
+		struct slot *slot = &in->slots[ in->consumed % INPUT_SLOTS ];
+		size_t n;
+
+		pthread_mutex_lock(&in->lock);
+		while( SLOT_READY != slot->state && in->consumed < in->end )
+			pthread_cond_wait(&in->cond, &in->lock);
+		pthread_mutex_unlock(&in->lock);
+
+		if( SLOT_READY != slot->state ) {
+			if( in->error && 0 == done ) {
+				errno = EIO;
+				return -1;
+			}
+			break;
+		}
+
+		n = slot->len - slot->pos;
+		if( n > size - done )
+			n = size - done;
+		memcpy(buf + done, slot->data + slot->pos, n);
+		slot->pos += n;
+		done += n;
+
+		if( slot->pos == slot->len ) {
+			pthread_mutex_lock(&in->lock);
+			slot->state = SLOT_EMPTY;
+			++in->consumed;
+			pthread_cond_broadcast(&in->cond);
+			pthread_mutex_unlock(&in->lock);
+		}
+	}
+
+	return done;
+}
+
+/**
+ * Функция закрытия потока (интерфейс fopencookie).
+ */
+static int input_close(void *cookie) {
+	struct input *in = (struct input*)cookie;
+	int i;
+
+	if( NULL != in->job ) {
+		pthread_mutex_lock(&in->lock);
+		in->stop = 1;
+		pthread_cond_broadcast(&in->cond);
+		pthread_mutex_unlock(&in->lock);
+
+		for(i = 0; i < in->nthreads; ++i)
+			pthread_join(in->threads[i], NULL);
+
+		pthread_cond_destroy(&in->cond);
+		pthread_mutex_destroy(&in->lock);
+	}
+
+	for(i = 0; i < INPUT_SLOTS; ++i)
+		free(in->slots[i].data);
+
+#ifdef HAVE_ZLIB
+	if( in->zs_init )
+		inflateEnd(&in->zs);
+#endif
+#ifdef HAVE_ZSTD
+	if( NULL != in->zds )
+		ZSTD_freeDStream(in->zds);
+#endif
+
+	if( NULL != in->map )
+		munmap((void*)in->map, in->map_len);
+
+	free(in->jobs);
+	free(in->ibuf);
+	close(in->fd);
+	free(in);
+	return 0;
+}
+
+/** Форматы входных данных. */
+enum input_format {INPUT_PLAIN, INPUT_GZIP, INPUT_ZSTD};
+
+/**
+ * Функция определения формата по сигнатуре.
+ * Форматы, не поддерживаемые сборкой, читаются как есть.
+ */
+static enum input_format input_format(const unsigned char *magic, size_t magic_len) {
+#ifdef HAVE_ZLIB
+	if( magic_len >= GZIP_MAGIC_LEN && 0 == memcmp(magic, GZIP_MAGIC, GZIP_MAGIC_LEN) )
+		return INPUT_GZIP;
+#endif
+#ifdef HAVE_ZSTD
+	if( magic_len >= ZSTD_MAGIC_LEN && 0 == memcmp(magic, ZSTD_MAGIC, ZSTD_MAGIC_LEN) )
+		return INPUT_ZSTD;
+#endif
+	(void)magic;
+	(void)magic_len;
+	return INPUT_PLAIN;
+}
+
+/**
+ * Функция выбора способа распаковки.
+ * Параллельная распаковка возможна, если файл отображён в память и
+ * состоит из независимых блоков известного размера.
+ * @return 0 -- не удалось инициализировать распаковку.
+ */
+static int input_setup(struct input *in, enum input_format format) {
+	long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+
+	in->nthreads = 1;
+
+	switch( format ) {
+#ifdef HAVE_ZLIB
+	case INPUT_GZIP:
+		if( NULL != in->map && nproc > 1 && gzip_split(in) && in->njobs > 1 ) {
+			in->job = gzip_block_job;
+			in->nthreads = nproc;
+			break;
+		}
+		in->njobs = 0;
+		if( Z_OK != inflateInit2(&in->zs, 16 + MAX_WBITS) )
+			return 0;
+		in->zs_init = 1;
+		in->job = gzip_stream_job;
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case INPUT_ZSTD:
+		if( NULL != in->map && nproc > 1 && zstd_split(in) && in->njobs > 1 ) {
+			in->job = zstd_block_job;
+			in->nthreads = nproc;
+			break;
+		}
+		in->njobs = 0;
+		if( NULL == (in->zds = ZSTD_createDStream()) )
+			return 0;
+		ZSTD_initDStream(in->zds);
+		in->job = zstd_stream_job;
+		break;
+#endif
+	default:
+		break;
+	}
+
+	if( in->nthreads > INPUT_MAX_THREADS )
+		in->nthreads = INPUT_MAX_THREADS;
+
+	return 1;
+}
+
+FILE *input_open(const char *pathname) {
+	static const cookie_io_functions_t io = { input_read, NULL, NULL, input_close };
+	unsigned char magic[4];
+	size_t magic_len = 0;
+	enum input_format format;
+	struct input *in;
+	struct stat st;
+	FILE *f;
+	int fd;
+	int i;
+
+	if( 0 == strcmp(pathname, "-") ) {
+		fd = STDIN_FILENO;
+		pathname = "stdin";
+	} else if( -1 == (fd = open(pathname, O_RDONLY)) )
+		return NULL;
+
+	if( -1 == fstat(fd, &st) ) {
+		close(fd);
+		return NULL;
+	}
+
+	/* читаем сигнатуру */
+	if( S_ISREG(st.st_mode) ) {
+		ssize_t rec = pread(fd, magic, sizeof(magic), 0);
+
+		if( rec > 0 )
+			magic_len = rec;
+	} else {
+		while( magic_len < sizeof(magic) ) {
+			ssize_t rec = read(fd, magic + magic_len, sizeof(magic) - magic_len);
+
+			if( -1 == rec && EINTR == errno )
+				continue;
+			if( rec <= 0 )
+				break;
+			magic_len += rec;
+		}
+	}
+
+	format = input_format(magic, magic_len);
+
+	/* несжатый обычный файл читаем как обычно */
+	if( INPUT_PLAIN == format && S_ISREG(st.st_mode) )
+		return STDIN_FILENO == fd ? stdin : fdopen(fd, "rb");
+
+	if( NULL == (in = (struct input*)calloc(1, sizeof(*in))) ) {
+		close(fd);
+		return NULL;
+	}
+
+	in->name = pathname;
+	in->fd = fd;
+	in->end = (size_t)-1;
+
+	if( S_ISREG(st.st_mode) ) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if( MAP_FAILED != map ) {
+			in->map = (const unsigned char*)map;
+			in->map_len = st.st_size;
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+		}
+	} else {
+		memcpy(in->head, magic, magic_len);
+		in->head_len = magic_len;
+	}
+
+	if( NULL == in->map && NULL == (in->ibuf = (unsigned char*)malloc(INPUT_CHUNK)) ) {
+		input_close(in);
+		return NULL;
+	}
+
+	if( !input_setup(in, format) ) {
+		input_close(in);
+		return NULL;
+	}
+
+	/* запускаем потоки распаковки */
+	if( NULL != in->job ) {
+		pthread_mutex_init(&in->lock, NULL);
+		pthread_cond_init(&in->cond, NULL);
+
+		for(i = 0; i < in->nthreads; ++i) {
+			if( 0 != pthread_create(&in->threads[i], NULL, input_worker, in) )
+				break;
+		}
+
+		if( 0 == (in->nthreads = i) ) {
+			pthread_cond_destroy(&in->cond);
+			pthread_mutex_destroy(&in->lock);
+			in->job = NULL;
+			input_close(in);
+			return NULL;
+		}
+	}
+
+	if( NULL == (f = fopencookie(in, "rb", io)) ) {
+		input_close(in);
+		return NULL;
+	}
+
+	return f;
+}
+
+#endif /* _WIN32 */
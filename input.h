@@ -0,0 +1,27 @@
+#ifndef __input_h__
+#define __input_h__
+
+#ifdef __cplusplus
+#include <cstdio>
+#else
+#include <stdio.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	/**
+	 * Функция открытия входного файла.
+	 * Формат данных определяется по сигнатуре: сжатые данные (gzip, zstd)
+	 * распаковываются внутри процесса, независимые блоки (кадры zstd,
+	 * блоки BGZF) распаковываются параллельно.
+	 * @param pathname путь_имя файла; "-" -- стандартный ввод
+	 * @return поток распакованных данных; NULL -- файл не удалось открыть
+	 */
+	FILE *input_open(const char *pathname);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__input_h__*/
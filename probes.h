@@ -0,0 +1,45 @@
+#ifndef __probes_h__
+#define __probes_h__
+
+/*
+ * Статические точки трассировки (USDT) провайдера extrac4.
+ * Если найден <sys/sdt.h> (пакет systemtap-sdt-dev), точки попадают в
+ * секцию .note.stapsdt и видны bpftrace/perf:
+ *   bpftrace -e 'usdt:./extrac4:extrac4:record__end { ... }'
+ * В выключенном состоянии точка -- одна инструкция nop.
+ * Без заголовка (или с -DNO_SDT) макросы не порождают кода, а аргументы
+ * не вычисляются.
+ *
+ * Точки и их аргументы:
+ *   record__begin  входной_файл, смещение
+ *   record__end    входной_файл, смещение, путь_имя, извлечена
+ *   tag__begin     заголовок
+ *   tag__end       путь_имя, размер, формат, разобран
+ *   decode__batch  путь_имя, строк, байт
+ *   crc__result    путь_имя, ожидаемая, рассчитанная
+ *   output__open   путь_имя, размер, открыт
+ *   output__write  путь_имя, байт (при раскодировании прямо в отображённый
+ *                  файл -- раз на пакет, вслед за decode__batch)
+ *   output__close  путь_имя, записано, успешно
+ */
+
+#if !defined(NO_SDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HAVE_SDT
+#endif
+#endif
+
+#ifdef HAVE_SDT
+#define PROBE1(name, a)             DTRACE_PROBE1(extrac4, name, a)
+#define PROBE2(name, a, b)          DTRACE_PROBE2(extrac4, name, a, b)
+#define PROBE3(name, a, b, c)       DTRACE_PROBE3(extrac4, name, a, b, c)
+#define PROBE4(name, a, b, c, d)    DTRACE_PROBE4(extrac4, name, a, b, c, d)
+#else
+#define PROBE1(name, a)             ((void)sizeof(a))
+#define PROBE2(name, a, b)          ((void)sizeof(a), (void)sizeof(b))
+#define PROBE3(name, a, b, c)       ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c))
+#define PROBE4(name, a, b, c, d)    ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c), (void)sizeof(d))
+#endif
+
+#endif /*__probes_h__*/
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "extrac4.h"
+#include "progress.h"
+
+/** Счётчики хода извлечения. */
+off_t progress_input;
+off_t progress_output;
+long progress_records;
+
+/** Вывод отчёта. */
+static int report_fd;
+static bool report_json;
+static struct timespec report_interval;
+
+/** Размеры входных файлов и их сумма; -1 -- объём входа неизвестен. */
+static off_t *file_sizes;
+static int file_count;
+static off_t input_total = -1;
+static long records_total = -1;
+
+/** Состояние, которое меняет основной поток (под lock). */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond;
+/* смещение начала текущего файла во всём входе */
+static off_t file_base;
+/* объём входа, с которого начат этот запуск; -1 -- файлов ещё не было */
+static off_t start_input = -1;
+static char record[ MAX_PATHNAME + 1 ];
+static bool stopping;
+
+static pthread_t thread;
+static bool running;
+static struct timespec started;
+
+/**
+ * Функция расчёта секунд между моментами a и b.
+ */
+static double seconds(const struct timespec *a, const struct timespec *b) {
+	return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+/**
+ * Процедура форматирования объёма в двоичных единицах.
+ */
+static void format_bytes(double n, char *buf, size_t size) {
+	static const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+	int u = 0;
+
+	while( n >= 1024 && u < 4 ) {
+		n /= 1024;
+		++u;
+	}
+	snprintf(buf, size, 0 == u ? "%.0f %s" : "%.1f %s", n, units[u]);
+}
+
+/**
+ * Функция экранирования строки для JSON.
+ * @return длина результата
+ */
+static size_t json_escape(const char *s, char *out) {
+	char *o = out;
+
+	for(; '\0' != *s; ++s) {
+		unsigned char c = (unsigned char)*s;
+
+		if( '"' == c || '\\' == c ) {
+			*o++ = '\\';
+			*o++ = c;
+		} else if( c < 0x20 )
+			o += sprintf(o, "\\u%04x", c);
+		else
+			*o++ = c;
+	}
+	*o = '\0';
+
+	return o - out;
+}
+
+/**
+ * Процедура вывода одной строки отчёта.
+ * @param done итоговая строка (после завершения извлечения)
+ */
+static void report(bool done) {
+	char name[ MAX_PATHNAME + 1 ];
+	char escaped[ 6 * MAX_PATHNAME + 1 ];
+	char buf[ 6 * MAX_PATHNAME + 512 ];
+	struct timespec now;
+	off_t input, output, base, start, total;
+	long records;
+	double elapsed, rate, eta = -1;
+	const char *p;
+	int len;
+
+	pthread_mutex_lock(&lock);
+	strcpy(name, record);
+	base = file_base;
+	start = start_input;
+	total = input_total;
+	pthread_mutex_unlock(&lock);
+
+	input = base + __atomic_load_n(&progress_input, __ATOMIC_RELAXED);
+	output = __atomic_load_n(&progress_output, __ATOMIC_RELAXED);
+	records = __atomic_load_n(&progress_records, __ATOMIC_RELAXED);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = seconds(&started, &now);
+	rate = elapsed > 0 && -1 != start ? (input - start) / elapsed : 0;
+
+	/* оставшееся время -- по объёму входа, иначе по числу записей */
+	if( -1 != total && rate > 0 )
+		eta = total > input ? (total - input) / rate : 0;
+	else if( -1 != records_total && records > 0 )
+		eta = records_total > records ? elapsed / records * (records_total - records) : 0;
+
+	if( report_json ) {
+		json_escape(name, escaped);
+		len = snprintf(buf, sizeof(buf), "{\"elapsed\": %.3f, \"input\": %lld, \"input_total\": %lld, \"records\": %ld, "
+				"\"records_total\": %ld, \"output\": %lld, \"rate\": %.0f, \"eta\": %.0f, \"record\": \"%s\", \"done\": %s}\n",
+				elapsed, (long long)input, (long long)total, records, records_total, (long long)output,
+				rate, eta, escaped, done ? "true" : "false");
+	} else {
+		char in_buf[32], total_buf[32], rate_buf[32], out_buf[32], eta_buf[32];
+
+		format_bytes(input, in_buf, sizeof(in_buf));
+		format_bytes(total, total_buf, sizeof(total_buf));
+		format_bytes(rate, rate_buf, sizeof(rate_buf));
+		format_bytes(output, out_buf, sizeof(out_buf));
+		if( eta < 0 )
+			strcpy(eta_buf, "?");
+		else
+			snprintf(eta_buf, sizeof(eta_buf), "%ld:%02ld:%02ld", (long)eta / 3600, (long)eta / 60 % 60, (long)eta % 60);
+
+		if( -1 != total && total > 0 )
+			len = snprintf(buf, sizeof(buf), "Progress: %s of %s (%.1f%%), %s/s, ETA %s; %ld record(s), %s written; '%s'\n",
+					in_buf, total_buf, 100.0 * input / total, rate_buf, eta_buf, records, out_buf, name);
+		else
+			len = snprintf(buf, sizeof(buf), "Progress: %s, %s/s, ETA %s; %ld record(s), %s written; '%s'\n",
+					in_buf, rate_buf, eta_buf, records, out_buf, name);
+	}
+
+	/* строка пишется одним вызовом и не перемешивается с чужим выводом в канале */
+	for(p = buf; len > 0; ) {
+		ssize_t n = write(report_fd, p, len);
+
+		if( n <= 0 && EINTR != errno )
+			break;
+		if( n > 0 ) {
+			p += n;
+			len -= n;
+		}
+	}
+}
+
+/**
+ * Поток отчёта: строка раз в интервал до остановки.
+ */
+static void *progress_thread(void *arg) {
+	struct timespec deadline;
+
+	(void)arg;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+	while( 1 ) {
+		bool stop;
+
+		deadline.tv_sec += report_interval.tv_sec;
+		if( (deadline.tv_nsec += report_interval.tv_nsec) >= 1000000000L ) {
+			deadline.tv_nsec -= 1000000000L;
+			++deadline.tv_sec;
+		}
+
+		pthread_mutex_lock(&lock);
+		while( !stopping && ETIMEDOUT != pthread_cond_timedwait(&cond, &lock, &deadline) );
+		stop = stopping;
+		pthread_mutex_unlock(&lock);
+
+		if( stop )
+			break;
+		report(false);
+	}
+
+	return NULL;
+}
+
+int progress_start(int fd, bool json, double interval, char **files, int nfiles, long nrecords) {
+	pthread_condattr_t attr;
+	bool known = true;
+	int i;
+
+	report_fd = fd;
+	report_json = json;
+	report_interval.tv_sec = (time_t)interval;
+	report_interval.tv_nsec = (long)((interval - (time_t)interval) * 1e9);
+	records_total = nrecords;
+
+	if( NULL != files ) {
+		if( NULL == (file_sizes = (off_t*)calloc(nfiles + 1, sizeof(*file_sizes))) )
+			return -1;
+		file_count = nfiles;
+		input_total = 0;
+
+		for(i = 0; i < nfiles; ++i) {
+			struct stat st;
+
+			if( 0 == stat(files[i], &st) && S_ISREG(st.st_mode) )
+				input_total += file_sizes[i] = st.st_size;
+			else
+				known = false;
+		}
+
+		/* стандартный ввод и каналы -- объём входа неизвестен */
+		if( !known )
+			input_total = -1;
+	}
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	clock_gettime(CLOCK_MONOTONIC, &started);
+
+	if( 0 != (errno = pthread_create(&thread, NULL, progress_thread, NULL)) )
+		return -1;
+	running = true;
+
+	return 0;
+}
+
+void progress_file(int index, bool seekable, off_t offset) {
+	off_t base = 0;
+	int i;
+
+	for(i = 0; i < index && i < file_count; ++i)
+		base += file_sizes[i];
+
+	pthread_mutex_lock(&lock);
+	/* смещение в распакованном потоке не соотносится с размером файла */
+	if( !seekable )
+		input_total = -1;
+	file_base = base;
+	if( -1 == start_input )
+		start_input = base + offset;
+	progress_set_input(offset);
+	pthread_mutex_unlock(&lock);
+}
+
+void progress_record(const char *pathname) {
+	pthread_mutex_lock(&lock);
+	strncpy(record, pathname, sizeof(record) - 1);
+	pthread_mutex_unlock(&lock);
+}
+
+void progress_stop() {
+	if( !running )
+		return;
+
+	pthread_mutex_lock(&lock);
+	stopping = true;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+
+	pthread_join(thread, NULL);
+	running = false;
+
+	if( report_json )
+		report(true);
+
+	free(file_sizes);
+	file_sizes = NULL;
+}
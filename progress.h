@@ -0,0 +1,73 @@
+#ifndef __progress_h__
+#define __progress_h__
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Get BOOL. */
+#include "base64.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	/**
+	 * Счётчики хода извлечения (читаются потоком отчёта).
+	 * Смещение в текущем входном файле, записанные байты и пройденные записи.
+	 */
+	extern off_t progress_input;
+	extern off_t progress_output;
+	extern long progress_records;
+
+	/**
+	 * Функция запуска потока отчёта о ходе извлечения (--progress).
+	 * Общий объём входа -- сумма размеров входных файлов (fstat); если
+	 * он неизвестен, оставшееся время оценивается по числу записей.
+	 * @param fd дескриптор вывода
+	 * @param json строки JSON (для планировщика заданий) вместо текста
+	 * @param interval интервал отчёта в секундах
+	 * @param files входные файлы; NULL -- вход не просматривается (каталог)
+	 * @param nrecords число извлекаемых записей; -1 -- неизвестно
+	 * @return 0 -- успешно; -1 -- ошибка (errno)
+	 */
+	int progress_start(int fd, bool json, double interval, char **files, int nfiles, long nrecords);
+
+	/**
+	 * Процедура начала входного файла.
+	 * @param index номер файла в списке progress_start()
+	 * @param seekable смещение в потоке -- смещение в файле (вход не сжат)
+	 * @param offset начальное смещение (продолжение с контрольной точки)
+	 */
+	void progress_file(int index, bool seekable, off_t offset);
+
+	/**
+	 * Процедура смены текущей записи.
+	 */
+	void progress_record(const char *pathname);
+
+	/**
+	 * Процедура остановки потока отчёта; в режиме JSON выводится итоговая
+	 * строка с "done": true.
+	 */
+	void progress_stop();
+
+	/**
+	 * Процедуры обновления счётчиков: одна запись в память без блокировки,
+	 * поэтому их можно вызывать на каждой строке.
+	 */
+	static inline void progress_set_input(off_t offset) {
+		__atomic_store_n(&progress_input, offset, __ATOMIC_RELAXED);
+	}
+
+	static inline void progress_add_output(size_t n) {
+		__atomic_fetch_add(&progress_output, (off_t)n, __ATOMIC_RELAXED);
+	}
+
+	static inline void progress_add_record() {
+		__atomic_fetch_add(&progress_records, 1, __ATOMIC_RELAXED);
+	}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__progress_h__*/
@@ -0,0 +1,512 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "base64.h"
+#include "crc.h"
+#include "extrac4.h"
+#include "repack.h"
+
+/** Данные строки переупакованной записи (60 символов base64, как у b64encode). */
+#define REPACK_LINE          (45)
+
+/** Размер буфера копирования. */
+#define REPACK_BUFSIZE       (64 * 1024)
+
+/** Суффикс временного файла контейнера. */
+#define REPACK_TMP           (".XXXXXX")
+
+/** Сигнатуры сжатых файлов: такие контейнеры не переписываются. */
+#define GZIP_MAGIC           ("\x1f\x8b")
+#define GZIP_MAGIC_LEN       (sizeof(GZIP_MAGIC) - 1)
+#define ZSTD_MAGIC           ("\x28\xb5\x2f\xfd")
+#define ZSTD_MAGIC_LEN       (sizeof(ZSTD_MAGIC) - 1)
+
+/** Множество символов -- признаков конца строки. */
+#define iseol(c) ('\0' == (c) || '\n' == (c) || '\r' == (c))
+/** Множество пробельных символов. */
+#define isspace(c) (' ' == (c) || '\t' == (c))
+
+/** Способ переупаковки записи. */
+enum repack_action {
+	/* запись остаётся как есть */
+	KEEP,
+	/* в заголовок добавляются опции, данные не меняются */
+	HEADER,
+	/* данные перекодируются строками по REPACK_LINE байт */
+	REENCODE
+};
+
+/** Результат просмотра записи. */
+struct record_shape {
+	enum repack_action action;
+	/* распакованный размер и контрольная сумма строк данных (как есть) */
+	off_t size;
+	u_int32_t crc;
+	/* смещения закрывающего тэга и следующей за ним строки */
+	off_t body_end;
+	off_t end;
+	/* причина оставить запись с ошибкой как есть; NULL -- ошибок нет */
+	const char *reason;
+};
+
+/** Статистика переупаковки. */
+struct repack_stat {
+	long records;
+	long repacked;
+	long broken;
+	/* размер переупакованных записей до и после */
+	off_t before;
+	off_t after;
+};
+
+/**
+ * Функция расчёта длины строки base64 для n байт данных (без перевода строки).
+ */
+static size_t line_length(size_t n) {
+	return B64URL == format ? n / 3 * 4 + (n % 3 ? n % 3 + 1 : 0) : base64_length(n);
+}
+
+/**
+ * Функция расчёта длины перекодированных данных записи.
+ */
+static off_t encoded_length(off_t size) {
+	off_t len = size / REPACK_LINE * (off_t)(line_length(REPACK_LINE) + 1);
+
+	if( 0 != size % REPACK_LINE )
+		len += line_length(size % REPACK_LINE) + 1;
+	return len;
+}
+
+/**
+ * Процедура просмотра данных записи, заголовок которой разобран parse_tag():
+ * считает размер и контрольную сумму, проверяет их по заголовку и решает,
+ * как переупаковать запись. Поток остаётся за записью.
+ * У разностной записи !size -- размер восстановленного файла, а не
+ * разностных данных: он не проверяется и не добавляется.
+ */
+static void analyze(char *line, size_t size, FILE *in, struct record_shape *s) {
+	base64_kernel kernel = base64_kernel_select(TXT != format, B64URL == format ? BASE64_URL : BASE64_STD, true);
+	char buf[ MAX_LINESIZE ];
+	bool normal = true;
+	bool last = false;
+	size_t len;
+	size_t n;
+
+	s->action = KEEP;
+	s->size = 0;
+	s->crc = 0;
+	s->reason = NULL;
+
+	while( 1 ) {
+		off_t start = in_offset;
+
+		if( 0 == (len = read_line(line, size, in)) ) {
+			s->reason = "Unterminated record";
+			return;
+		}
+
+		if( is_end_line(line) ) {
+			s->body_end = start;
+			s->end = in_offset;
+			break;
+		}
+
+		if( BASE64_KERNEL_FAIL == (n = kernel(line, len, buf, &s->crc)) ) {
+			s->reason = "Incorrect base64 code";
+			skip_record(line, size, in);
+			return;
+		}
+		s->size += n;
+
+		/* уже нормальный вид: полные строки LF, короче -- только последняя */
+		if( TXT != format ) {
+			if( last || n > REPACK_LINE || len < 2 || '\n' != line[len - 1] || '\r' == line[len - 2] || len - 1 != line_length(n) )
+				normal = false;
+			if( n < REPACK_LINE )
+				last = true;
+		}
+	}
+
+	if( crc_check_flag && crc_old_value != s->crc )
+		s->reason = "CRC32 failed";
+	else if( -1 != out_size && !delta_flag && out_size != s->size )
+		s->reason = "Size mismatch";
+	else if( !normal )
+		s->action = REENCODE;
+	else if( !crc_check_flag || (-1 == out_size && !delta_flag) )
+		s->action = HEADER;
+}
+
+/**
+ * Функция построения заголовка переупакованной записи: тэг и путь_имя --
+ * как в исходной строке, опции размера и контрольной суммы заменяются
+ * рассчитанными, остальные опции и комментарий сохраняются.
+ * @param head исходная строка заголовка
+ * @param b параметры тэга внутри head
+ * @param size распакованный размер; -1 -- опция !size сохраняется как есть
+ * @param crc_pos позиция контрольной суммы в заголовке
+ * @return длина заголовка; 0 -- заголовок не помещается в out_max
+ *         (запись остаётся как есть)
+ */
+static size_t make_header(const char *head, const char *b, off_t size, u_int32_t crc, char *out, size_t out_max, size_t *crc_pos) {
+	const char *p = b;
+	const char *comment = NULL;
+	size_t len;
+	int n;
+
+	/* путь_имя -- до первого неэкранированного пробела */
+	while( isspace(*p) ) ++p;
+	while( !iseol(*p) && !isspace(*p) )
+		p += ('\\' == *p && !iseol(p[1])) ? 2 : 1;
+
+	if( (len = p - head) >= out_max )
+		return 0;
+	memcpy(out, head, len);
+
+	while( 1 ) {
+		const char *e;
+
+		while( isspace(*p) ) ++p;
+		if( iseol(*p) )
+			break;
+
+		if( 0 == strncmp("!comment", p, 8) ) {
+			comment = p;
+			break;
+		}
+
+		/* опции могут идти и без пробелов между ними */
+		for(e = p + 1; !iseol(*e) && !isspace(*e) && '!' != *e; ++e);
+
+		/* всё, что не формат, индекс или разность, -- размер либо контрольная сумма */
+		if( '!' == *p && (0 == strncmp("!text", p, 5) || 0 == strncmp("!base64", p, 7)
+				|| 0 == strncmp("!index=", p, 7) || 0 == strncmp("!delta=", p, 7)
+				|| (-1 == size && 0 == strncmp("!size=", p, 6))) ) {
+			if( len + 1 + (e - p) >= out_max )
+				return 0;
+			out[ len++ ] = ' ';
+			memcpy(out + len, p, e - p);
+			len += e - p;
+		}
+		p = e;
+	}
+
+	if( -1 == size )
+		n = snprintf(out + len, out_max - len, " !%08x", (unsigned)crc);
+	else
+		n = snprintf(out + len, out_max - len, " !size=%lld !%08x", (long long)size, (unsigned)crc);
+	if( n < 0 || (size_t)n >= out_max - len )
+		return 0;
+	*crc_pos = len + n - 8;
+	len += n;
+
+	if( NULL != comment ) {
+		size_t c = strcspn(comment, "\r\n");
+
+		if( len + 1 + c >= out_max )
+			return 0;
+		out[ len++ ] = ' ';
+		memcpy(out + len, comment, c);
+		len += c;
+	}
+
+	/* перевод строки -- как в исходном заголовке */
+	p = head + strcspn(head, "\r\n");
+	if( len + strlen(p) >= out_max )
+		return 0;
+	strcpy(out + len, p);
+
+	return len + strlen(p);
+}
+
+/**
+ * Функция копирования участка входного файла [from, to) в выходной.
+ * Позиция входного потока не меняется.
+ * @return 0 -- успешно; -1 -- ошибка чтения или записи
+ */
+static int copy_range(FILE *in, off_t from, off_t to, FILE *out) {
+	char buf[ REPACK_BUFSIZE ];
+
+	while( from < to ) {
+		size_t n = to - from < (off_t)sizeof(buf) ? (size_t)(to - from) : sizeof(buf);
+		ssize_t rec = pread(fileno(in), buf, n, from);
+
+		if( rec <= 0 || 1 != fwrite(buf, rec, 1, out) )
+			return -1;
+		from += rec;
+	}
+
+	return 0;
+}
+
+/**
+ * Функция вывода строки перекодированных данных.
+ * @return 0 -- успешно; -1 -- ошибка записи
+ */
+static int put_line(const char *data, size_t n, u_int32_t *crc, FILE *out) {
+	char line[ base64_length(REPACK_LINE) + 1 ];
+	size_t len = B64URL == format ? base64url_encode(data, n, line, sizeof(line)) : base64_encode(data, n, line, sizeof(line));
+
+	line[ len++ ] = '\n';
+	*crc = crc_calc_array(*crc, line, len);
+	return 1 == fwrite(line, len, 1, out) ? 0 : -1;
+}
+
+/**
+ * Функция перекодирования данных записи [data, body_end) строками по
+ * REPACK_LINE байт.
+ * @return 0 -- успешно; -1 -- ошибка чтения или записи
+ */
+static int reencode(char *line, size_t size, FILE *in, off_t data, off_t body_end, u_int32_t *crc, FILE *out) {
+	base64_kernel kernel = base64_kernel_select(true, B64URL == format ? BASE64_URL : BASE64_STD, false);
+	char buf[ MAX_LINESIZE + REPACK_LINE ];
+	size_t buf_len = 0;
+	size_t len;
+
+	if( 0 != fseeko(in, data, SEEK_SET) )
+		return -1;
+	in_offset = data;
+	*crc = 0;
+
+	while( in_offset < body_end && 0 != (len = read_line(line, size, in)) ) {
+		size_t n = kernel(line, len, buf + buf_len, NULL);
+		size_t k;
+
+		if( BASE64_KERNEL_FAIL == n )
+			return -1;
+		buf_len += n;
+
+		for(k = 0; buf_len - k >= REPACK_LINE; k += REPACK_LINE)
+			if( 0 != put_line(buf + k, REPACK_LINE, crc, out) )
+				return -1;
+		memmove(buf, buf + k, buf_len -= k);
+	}
+
+	if( in_offset != body_end )
+		return -1;
+
+	if( 0 != buf_len && 0 != put_line(buf, buf_len, crc, out) )
+		return -1;
+
+	return 0;
+}
+
+/**
+ * Функция переупаковки контейнера.
+ * @return 0 -- успешно; -1 -- ошибка (сообщение выведено)
+ */
+static int repack_file(const char *pathname, bool dry_run, bool verbose, struct repack_stat *total) {
+	char line[ MAX_LINESIZE ];
+	char head[ MAX_LINESIZE ];
+	/* переписанный заголовок должен читаться read_line() одной строкой */
+	char header[ MAX_LINESIZE ];
+	unsigned char magic[4];
+	struct repack_stat st;
+	struct stat sb;
+	char *tmp = NULL;
+	char *b;
+	off_t copied = 0;
+	FILE *in;
+	FILE *out = NULL;
+	int rc = -1;
+
+	memset(&st, 0, sizeof(st));
+
+	if( NULL == (in = fopen(pathname, "rb")) ) {
+		fprintf(stderr, "Can't open input file '%s'.\n", pathname);
+		return -1;
+	}
+
+	if( -1 == fstat(fileno(in), &sb) || !S_ISREG(sb.st_mode) ) {
+		fprintf(stderr, "%s: %s\n", pathname, "Not a regular file.");
+		goto _done;
+	}
+
+	/* сжатый контейнер пришлось бы сжимать заново */
+	if( sizeof(magic) == pread(fileno(in), magic, sizeof(magic), 0)
+			&& (0 == memcmp(magic, GZIP_MAGIC, GZIP_MAGIC_LEN) || 0 == memcmp(magic, ZSTD_MAGIC, ZSTD_MAGIC_LEN)) ) {
+		fprintf(stderr, "%s: %s\n", pathname, "Can't repack compressed file.");
+		goto _done;
+	}
+
+	if( !dry_run ) {
+		int fd;
+
+		if( NULL == (tmp = (char*)malloc(strlen(pathname) + sizeof(REPACK_TMP))) )
+			goto _done;
+		strcpy(tmp, pathname);
+		strcat(tmp, REPACK_TMP);
+
+		if( -1 == (fd = mkstemp(tmp)) ) {
+			fprintf(stderr, "%s: %s: %s\n", pathname, "Can't create temporary file", strerror(errno));
+			free(tmp);
+			tmp = NULL;
+			goto _done;
+		}
+		if( -1 == fchmod(fd, sb.st_mode & 07777) || NULL == (out = fdopen(fd, "wb")) ) {
+			close(fd);
+			goto _fail_io;
+		}
+	}
+
+	in_pathname = (char*)pathname;
+	in_offset = 0;
+
+	while( NULL != (b = find_tag(line, sizeof(line), in)) ) {
+		struct record_shape s;
+		off_t tag = in_offset - strlen(line);
+		off_t data = in_offset;
+		size_t header_len = 0;
+		size_t crc_pos = 0;
+		bool parsed;
+
+		++st.records;
+
+		/* строка заголовка понадобится после чтения данных */
+		strcpy(head, line);
+		b = head + (b - line);
+
+		init_record();
+		parsed = parse_tag(b);
+
+		/* блоки begin-base64 и записи с индексом остаются как есть */
+		if( !parsed || legacy_flag || 0 != index_block || '\n' != head[ strlen(head) - 1 ] ) {
+			if( !parsed )
+				++st.broken;
+			skip_record(line, sizeof(line), in);
+			continue;
+		}
+
+		analyze(line, sizeof(line), in, &s);
+
+		if( NULL != s.reason ) {
+			fprintf(stderr, "%s: %s: %s.\n", in_pathname, out_pathname, s.reason);
+			++st.broken;
+			continue;
+		}
+
+		if( KEEP == s.action )
+			continue;
+
+		if( REENCODE == s.action )
+			s.crc = 0;
+		if( 0 == (header_len = make_header(head, b, delta_flag ? -1 : s.size, s.crc, header, sizeof(header), &crc_pos)) )
+			continue;
+
+		++st.repacked;
+		st.before += s.end - tag;
+		st.after += header_len + (REENCODE == s.action ? encoded_length(s.size) : s.body_end - data) + (s.end - s.body_end);
+
+		if( NULL == out )
+			continue;
+
+		/* текст до записи -- байт в байт */
+		if( 0 != copy_range(in, copied, tag, out) )
+			goto _fail_io;
+
+		if( REENCODE == s.action ) {
+			off_t header_pos = ftello(out);
+			u_int32_t crc;
+			char hex[9];
+
+			if( 1 != fwrite(header, header_len, 1, out)
+					|| 0 != reencode(line, sizeof(line), in, data, s.body_end, &crc, out) )
+				goto _fail_io;
+
+			/* контрольная сумма известна только после перекодирования */
+			snprintf(hex, sizeof(hex), "%08x", (unsigned)crc);
+			if( 0 != fseeko(out, header_pos + crc_pos, SEEK_SET) || 1 != fwrite(hex, 8, 1, out) || 0 != fseeko(out, 0, SEEK_END) )
+				goto _fail_io;
+
+			if( 0 != fseeko(in, s.end, SEEK_SET) )
+				goto _fail_io;
+			in_offset = s.end;
+		} else if( 1 != fwrite(header, header_len, 1, out) || 0 != copy_range(in, data, s.body_end, out) )
+			goto _fail_io;
+
+		if( 0 != copy_range(in, s.body_end, s.end, out) )
+			goto _fail_io;
+		copied = s.end;
+	}
+
+	if( ferror(in) ) {
+		fprintf(stderr, "%s: Read error occurred during parse input file.\n", pathname);
+		goto _done;
+	}
+
+	if( NULL != out ) {
+		/* менять нечего: контейнер (и время его модификации) не трогаем */
+		if( 0 == st.repacked ) {
+			fclose(out);
+			out = NULL;
+			remove(tmp);
+		} else {
+			if( 0 != copy_range(in, copied, in_offset, out) || 0 != fflush(out) || 0 != fsync(fileno(out)) )
+				goto _fail_io;
+			if( 0 != fclose(out) ) {
+				out = NULL;
+				goto _fail_io;
+			}
+			out = NULL;
+			if( 0 != rename(tmp, pathname) )
+				goto _fail_io;
+		}
+		free(tmp);
+		tmp = NULL;
+	}
+
+	if( verbose )
+		fprintf(stderr, "%s '%s': %ld record(s), %ld repacked, %ld with errors; %lld -> %lld bytes.\n",
+				dry_run ? "Would repack" : "Repacked", pathname, st.records, st.repacked, st.broken,
+				(long long)st.before, (long long)st.after);
+
+	total->records += st.records;
+	total->repacked += st.repacked;
+	total->broken += st.broken;
+	total->before += st.before;
+	total->after += st.after;
+	rc = 0;
+	goto _done;
+
+ _fail_io:
+	fprintf(stderr, "%s: %s\n", pathname, "Write error occurred during repacking.");
+
+ _done:
+	if( NULL != out )
+		fclose(out);
+	if( NULL != tmp ) {
+		remove(tmp);
+		free(tmp);
+	}
+	fclose(in);
+	return rc;
+}
+
+int repack_run(char **files, int nfiles, bool dry_run) {
+	struct repack_stat total;
+	bool verbose = !(flags & QUIET);
+	int rc = EXIT_SUCCESS;
+	int i;
+
+	memset(&total, 0, sizeof(total));
+
+	/* сообщения разбора заголовков -- отдельными строками */
+	flags |= QUIET;
+
+	for(i = 0; i < nfiles; ++i)
+		if( 0 != repack_file(files[i], dry_run, verbose, &total) )
+			rc = EXIT_FAILURE;
+
+	fprintf(stderr, "There are %ld record(s), %s %ld record(s), %lld bytes %s.\n", total.records,
+			dry_run ? "would repack" : "repacked", total.repacked,
+			(long long)(total.before >= total.after ? total.before - total.after : total.after - total.before),
+			total.before >= total.after ? (dry_run ? "would be saved" : "saved") : (dry_run ? "would be added" : "added"));
+
+	return rc;
+}
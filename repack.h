@@ -0,0 +1,29 @@
+#ifndef __repack_h__
+#define __repack_h__
+
+/* Get BOOL. */
+#include "base64.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	/**
+	 * Функция переупаковки контейнеров (--repack).
+	 * Записи base64 перекодируются строками по 45 байт (60 символов, как
+	 * у b64encode) с переводом строки LF, в заголовок записей добавляются
+	 * рассчитанные опции !size и контрольная сумма. Текст вне записей,
+	 * блоки begin-base64, записи с индексом и записи с ошибками остаются
+	 * байт в байт. Контейнер заменяется переименованием временного файла;
+	 * если менять нечего, файл не трогается.
+	 * @param files путь_имена контейнеров
+	 * @param nfiles количество контейнеров
+	 * @param dry_run только подсчитать, сколько байт даст переупаковка
+	 * @return код завершения программы
+	 */
+	int repack_run(char **files, int nfiles, bool dry_run);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__repack_h__*/
@@ -0,0 +1,45 @@
+#ifndef __sha256_h__
+#define __sha256_h__
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
+/** Размер дайджеста SHA-256 в байтах. */
+#define SHA256_DIGEST_SIZE   (32)
+
+/** Состояние расчёта SHA-256 (FIPS 180-4). */
+struct sha256 {
+	u_int32_t state[8];
+	u_int64_t length;
+	unsigned char block[64];
+	size_t used;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	/**
+	 * Процедура начала расчёта дайджеста.
+	 */
+	void sha256_init(struct sha256 *ctx);
+
+	/**
+	 * Процедура добавления данных в дайджест.
+	 */
+	void sha256_update(struct sha256 *ctx, const void *data, size_t size);
+
+	/**
+	 * Процедура завершения расчёта: дайджест записывается в digest.
+	 */
+	void sha256_final(struct sha256 *ctx, unsigned char digest[ SHA256_DIGEST_SIZE ]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__sha256_h__*/
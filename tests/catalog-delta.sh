@@ -0,0 +1,34 @@
+#!/bin/sh
+# Извлечение по каталогу последней из цепочки разностных записей: цепочка
+# применяется с полной записи, а диапазон разностной записи не читается.
+# Каталог, построенный по относительным путям, работает из другого каталога.
+set -e
+
+top=$(cd "$(dirname "$0")/.." && pwd)
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+head -c 300000 /dev/urandom > v1
+{ head -c 100000 v1; head -c 5000 /dev/urandom; tail -c +100001 v1; } > v2
+{ cat v2; head -c 5000 /dev/urandom; } > v3
+
+cp v1 d.bin
+"$top/b64encode" -t d.bin full.txt
+cp v2 d.bin
+"$top/b64encode" -t -d v1 d.bin delta2.txt
+cp v3 d.bin
+"$top/b64encode" -t -d v2 d.bin delta3.txt
+cat full.txt delta2.txt delta3.txt > c.txt
+rm d.bin
+
+# контейнер указан относительно, а извлекаем из другого каталога
+"$top/extrac4" -q --update-catalog=cat c.txt
+mkdir out
+cd out
+"$top/extrac4" -q --catalog=../cat d.bin
+cmp d.bin ../v3
+
+if "$top/extrac4" --catalog=../cat --range=d.bin:0-10 > range.out 2>/dev/null; then
+	exit 1
+fi
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Переупаковка контейнера с разностной записью: !size разностной записи --
+# размер восстановленного файла, и после --repack запись извлекается как раньше.
+set -e
+
+top=$(cd "$(dirname "$0")/.." && pwd)
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+head -c 300000 /dev/urandom > v1
+{ head -c 100000 v1; head -c 5000 /dev/urandom; tail -c +100001 v1 | head -c 150000; } > v2
+
+cp v1 d.bin
+"$top/b64encode" -t d.bin full.txt
+cp v2 d.bin
+"$top/b64encode" -t -d v1 d.bin delta.txt
+# та же разность без !size
+sed '1s/ !size=[0-9]*//' delta.txt > nosize.txt
+cat full.txt delta.txt > c.txt
+cat full.txt nosize.txt > c2.txt
+rm d.bin
+
+"$top/extrac4" -q --repack c.txt c2.txt
+
+grep -q '^<++> d.bin !base64 !size=255000 !delta=[0-9a-f]* ![0-9a-f]\{8\}$' c.txt
+grep -q '^<++> d.bin !base64 !delta=[0-9a-f]* ![0-9a-f]\{8\}$' c2.txt
+
+"$top/extrac4" -q c.txt
+cmp d.bin v2
+rm d.bin
+"$top/extrac4" -q c2.txt
+cmp d.bin v2
+
+# повторная переупаковка ничего не меняет
+cp c.txt c.orig
+"$top/extrac4" -q --repack c.txt
+cmp c.txt c.orig
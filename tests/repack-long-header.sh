@@ -0,0 +1,21 @@
+#!/bin/sh
+# Заголовок, который после добавления !size и контрольной суммы не
+# поместился бы в строку MAX_LINESIZE, переупаковка оставляет как есть.
+set -e
+
+top=$(cd "$(dirname "$0")/.." && pwd)
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+echo hello > f.txt
+comment=$(head -c 2016 /dev/zero | tr '\0' x)
+"$top/b64encode" -t f.txt | sed "1s/ !size=[0-9]*//; 1s/\$/ !comment $comment/" > c.txt
+rm f.txt
+
+cp c.txt c.orig
+"$top/extrac4" -q --repack c.txt
+cmp c.txt c.orig
+
+"$top/extrac4" -q c.txt
+test "$(cat f.txt)" = hello
@@ -0,0 +1,51 @@
+#!/bin/sh
+# Потоковая распаковка zstd: вход и распакованные данные больше буфера
+# распаковки (INPUT_CHUNK), несколько кадров без размера и без контрольной
+# суммы, чтение из файла и со стандартного ввода.
+set -e
+
+top=$(cd "$(dirname "$0")/.." && pwd)
+
+# поддержка zstd подключается при сборке, если её находит pkg-config
+if ! pkg-config --exists libzstd || ! command -v zstd > /dev/null; then
+	echo "zstd is not available, skipped"
+	exit 0
+fi
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+head -c 400000 /dev/urandom > rnd.bin
+"$top/b64encode" -t rnd.bin c.txt
+{
+	echo '<++> text.txt !text'
+	i=0
+	while [ $i -lt 40000 ]; do
+		echo "line $i of a compressible text record"
+		i=$((i + 1))
+	done
+	echo '<-->'
+} >> c.txt
+sed -n '/^<++> text.txt/,/^<-->/p' c.txt | sed '1d;$d' > text.orig
+mv rnd.bin rnd.orig
+
+# кадры сжимаются со стандартного ввода: размер в заголовке кадра неизвестен
+head -c 100001 c.txt | zstd -q --no-check -c > c.zst
+tail -c +100002 c.txt | zstd -q --no-check -c >> c.zst
+
+"$top/extrac4" -q c.zst
+cmp rnd.bin rnd.orig
+cmp text.txt text.orig
+rm rnd.bin text.txt
+
+"$top/extrac4" -q - < c.zst
+cmp rnd.bin rnd.orig
+cmp text.txt text.orig
+
+# оборванный файл -- ошибка, а не тихо укороченные данные
+head -c 300000 c.zst > cut.zst
+if "$top/extrac4" -q cut.zst 2> err.txt; then
+	exit 1
+fi
+grep -q 'Unexpected end of zstd data' err.txt
@@ -0,0 +1,398 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/types.h>
+
+#include "extrac4.h"
+#include "wikixml.h"
+#include "watch.h"
+#include "durable.h"
+
+/** События каталога, после которых входной файл просматривается заново. */
+#define WATCH_EVENTS         (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+/** Размер буфера событий inotify. */
+#define WATCH_BUFSIZE        (64 * 1024)
+
+/** Запись входного файла. */
+struct span {
+	/* имя из заголовка (как записано, до разбора) */
+	char *key;
+	/* смещение, с которого find_tag() находит запись */
+	off_t offset;
+	/* контрольная сумма заголовка и закодированного содержимого */
+	u_int32_t crc;
+	/* разностная запись (!delta): применяется к результату предыдущих */
+	bool delta;
+};
+
+/** Наблюдаемый входной файл. */
+struct watched {
+	const char *pathname;
+	/* имя файла внутри наблюдаемого каталога */
+	const char *name;
+	int wd;
+	int changed;
+
+	struct span *spans;
+	size_t nspans;
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+	(void)sig;
+	stop = 1;
+}
+
+/**
+ * Функция поиска конца имени в параметрах тэга (первый неэкранированный пробел).
+ */
+static const char *key_end(const char *b) {
+	for(; '\0' != *b && '\n' != *b && '\r' != *b && ' ' != *b && '\t' != *b; ++b) {
+		if( '\\' == *b && '\0' != b[1] )
+			++b;
+	}
+	return b;
+}
+
+/**
+ * Функция выделения имени из параметров тэга (до первого неэкранированного пробела).
+ */
+static char *tag_key(const char *b) {
+	while( ' ' == *b || '\t' == *b )
+		++b;
+
+	/* блок begin-base64: путь_имя после прав доступа до конца строки */
+	if( legacy_flag ) {
+		while( '0' <= *b && *b <= '7' )
+			++b;
+		while( ' ' == *b || '\t' == *b )
+			++b;
+		return strndup(b, strcspn(b, "\r\n"));
+	}
+	return strndup(b, key_end(b) - b);
+}
+
+/**
+ * Функция проверки, что в опциях тэга (до комментария) есть !delta.
+ */
+static bool tag_delta(const char *b) {
+	const char *d;
+	const char *c;
+
+	if( legacy_flag )
+		return false;
+
+	while( ' ' == *b || '\t' == *b )
+		++b;
+	b = key_end(b);
+
+	d = strstr(b, "!delta=");
+	c = strstr(b, "!comment");
+	return NULL != d && (NULL == c || d < c);
+}
+
+/**
+ * Процедура освобождения списка записей.
+ */
+static void spans_free(struct span *spans, size_t n) {
+	size_t i;
+
+	for(i = 0; i < n; ++i)
+		free(spans[i].key);
+	free(spans);
+}
+
+/**
+ * Функция просмотра входного файла без распаковки: положения записей и
+ * контрольные суммы их строк.
+ * @return 0 -- успешно; -1 -- файл не удалось прочитать.
+ */
+static int scan(struct watched *w, struct span **spans, size_t *nspans) {
+	char line[ MAX_LINESIZE ];
+	size_t cap = 0;
+	FILE *in;
+	int rc = 0;
+
+	*spans = NULL;
+	*nspans = 0;
+
+	if( NULL == (in = open_input(w->pathname)) )
+		return -1;
+
+	in_pathname = (char*)w->pathname;
+	in_offset = 0;
+
+	while( 1 ) {
+		off_t offset = in_offset;
+		char *b = find_tag(line, sizeof(line), in);
+		struct span *s;
+		u_int32_t crc;
+
+		if( NULL == b )
+			break;
+
+		if( *nspans == cap ) {
+			cap = cap ? 2 * cap : 16;
+			if( NULL == (s = (struct span*)realloc(*spans, cap * sizeof(*s))) ) {
+				rc = -1;
+				break;
+			}
+			*spans = s;
+		}
+
+		s = &(*spans)[ *nspans ];
+		s->offset = offset;
+		s->delta = tag_delta(b);
+		if( NULL == (s->key = tag_key(b)) ) {
+			rc = -1;
+			break;
+		}
+		++*nspans;
+
+		/* путь_имя записи зависит и от заголовка статьи */
+		crc = (flags & XML_TITLES) ? crc_calc_string(0, wikixml_title()) : 0;
+		crc = crc_calc_string(crc, b);
+		s->crc = hash_record(line, sizeof(line), in, crc);
+	}
+
+	if( ferror(in) )
+		rc = -1;
+	fclose(in);
+
+	if( 0 != rc ) {
+		spans_free(*spans, *nspans);
+		*spans = NULL;
+		*nspans = 0;
+	}
+	return rc;
+}
+
+/**
+ * Функция поиска в старом списке записи с тем же именем и тем же
+ * порядковым номером среди записей с этим именем.
+ */
+static const struct span *span_find(const struct watched *w, const char *key, size_t nth) {
+	size_t i;
+
+	for(i = 0; i < w->nspans; ++i) {
+		if( 0 == strcmp(w->spans[i].key, key) && 0 == nth-- )
+			return &w->spans[i];
+	}
+	return NULL;
+}
+
+/**
+ * Процедура обновления входного файла: извлекаются только изменившиеся записи.
+ */
+static void update(struct watched *w) {
+	char line[ MAX_LINESIZE ];
+	struct span *spans;
+	size_t nspans;
+	char *todo;
+	size_t i, j;
+	size_t start;
+	size_t count = 0;
+	FILE *in;
+
+	if( 0 != scan(w, &spans, &nspans) ) {
+		fprintf(stderr, "%s: Read error occurred during parse input file.\n", w->pathname);
+		return;
+	}
+
+	if( NULL == (todo = (char*)calloc(nspans + 1, 1)) ) {
+		spans_free(spans, nspans);
+		return;
+	}
+
+	for(i = 0; i < nspans; ++i) {
+		const struct span *old;
+		size_t nth = 0;
+
+		if( todo[i] )
+			continue;
+
+		for(j = 0; j < i; ++j)
+			nth += (0 == strcmp(spans[j].key, spans[i].key));
+
+		if( NULL != (old = span_find(w, spans[i].key, nth)) && old->crc == spans[i].crc )
+			continue;
+
+		/*
+		 * Разностная запись применяется к результату предыдущих, а в файле
+		 * уже результат старой версии: извлекаем заново с ближайшей
+		 * предыдущей полной записи с тем же именем (если она есть).
+		 */
+		start = i;
+		if( spans[i].delta ) {
+			for(j = i; j-- > 0; ) {
+				if( 0 == strcmp(spans[j].key, spans[i].key) && !spans[j].delta ) {
+					start = j;
+					break;
+				}
+			}
+		}
+
+		/* следующие записи с тем же именем перезаписывают результат */
+		for(j = start; j < nspans; ++j) {
+			if( !todo[j] && 0 == strcmp(spans[j].key, spans[i].key) ) {
+				todo[j] = 1;
+				++count;
+			}
+		}
+	}
+
+	spans_free(w->spans, w->nspans);
+	w->spans = spans;
+	w->nspans = nspans;
+
+	if( 0 == count ) {
+		free(todo);
+		return;
+	}
+
+	if( !(flags & QUIET) )
+		fprintf(stderr, "Updating '%s' (%lu of %lu record(s))...\n", w->pathname, (unsigned long)count, (unsigned long)nspans);
+
+	if( NULL == (in = open_input(w->pathname)) ) {
+		free(todo);
+		return;
+	}
+
+	in_pathname = (char*)w->pathname;
+	in_offset = 0;
+
+	for(i = 0; i < nspans; ++i) {
+		char *b;
+
+		if( !todo[i] )
+			continue;
+
+		/* сжатый поток не позиционируется: пропускаем строки до записи */
+		if( 0 == fseeko(in, spans[i].offset, SEEK_SET) )
+			in_offset = spans[i].offset;
+		else
+			while( in_offset < spans[i].offset && read_line(line, sizeof(line), in) );
+
+		if( NULL == (b = find_tag(line, sizeof(line), in)) )
+			break;
+
+		extract_record(b, line, sizeof(line), in);
+
+		if( ferror(in) ) {
+			fprintf(stderr, "%s: Read error occurred during parse input file.\n", w->pathname);
+			break;
+		}
+	}
+
+	fclose(in);
+	free(todo);
+
+	/* изменения файла фиксируются одной группой (--durable) */
+	durable_commit();
+}
+
+int watch_run(char **files, int nfiles) {
+	struct watched *watched;
+	struct sigaction sa;
+	char *buf;
+	int fd;
+	int i;
+
+	if( NULL == (watched = (struct watched*)calloc(nfiles, sizeof(*watched)))
+			|| NULL == (buf = (char*)malloc(WATCH_BUFSIZE)) ) {
+		fprintf(stderr, "%s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if( -1 == (fd = inotify_init1(IN_CLOEXEC)) ) {
+		fprintf(stderr, "inotify: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	/* наблюдаем каталоги: редакторы часто заменяют файл переименованием */
+	for(i = 0; i < nfiles; ++i) {
+		struct watched *w = &watched[i];
+		const char *slash = strrchr(files[i], '/');
+		char *dir;
+
+		w->pathname = files[i];
+		w->name = slash ? slash + 1 : files[i];
+
+		if( NULL == (dir = slash ? strndup(files[i], slash - files[i] + (slash == files[i])) : strdup(".")) )
+			return EXIT_FAILURE;
+
+		/* стандартный ввод и каталоги наблюдать нельзя */
+		if( '\0' == *w->name || 0 == strcmp(files[i], "-") ) {
+			fprintf(stderr, "%s: %s\n", files[i], "Can't watch this file.");
+			free(dir);
+			return EXIT_FAILURE;
+		}
+
+		if( -1 == (w->wd = inotify_add_watch(fd, dir, WATCH_EVENTS)) ) {
+			fprintf(stderr, "%s: %s\n", files[i], strerror(errno));
+			free(dir);
+			return EXIT_FAILURE;
+		}
+		free(dir);
+
+		update(w);
+	}
+
+	/* read() прерывается сигналом завершения */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	if( !(flags & QUIET) )
+		fprintf(stderr, "Watching %d file(s)...\n", nfiles);
+
+	while( !stop ) {
+		ssize_t len = read(fd, buf, WATCH_BUFSIZE);
+		char *p;
+
+		if( -1 == len ) {
+			if( EINTR == errno )
+				continue;
+			fprintf(stderr, "inotify: %s\n", strerror(errno));
+			break;
+		}
+
+		for(p = buf; p < buf + len; ) {
+			const struct inotify_event *ev = (const struct inotify_event*)p;
+
+			for(i = 0; i < nfiles; ++i) {
+				/* при переполнении очереди просматриваем все файлы */
+				if( (ev->mask & IN_Q_OVERFLOW)
+						|| (watched[i].wd == ev->wd && ev->len > 0 && 0 == strcmp(ev->name, watched[i].name)) )
+					watched[i].changed = 1;
+			}
+			p += sizeof(*ev) + ev->len;
+		}
+
+		for(i = 0; i < nfiles; ++i) {
+			if( watched[i].changed ) {
+				watched[i].changed = 0;
+				update(&watched[i]);
+			}
+		}
+	}
+
+	close(fd);
+	for(i = 0; i < nfiles; ++i)
+		spans_free(watched[i].spans, watched[i].nspans);
+	free(watched);
+	free(buf);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,23 @@
+#ifndef __watch_h__
+#define __watch_h__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	/**
+	 * Функция работы в режиме наблюдения за входными файлами (inotify).
+	 * Сначала извлекаются все записи; затем при каждой записи входного
+	 * файла он просматривается без распаковки и заново извлекаются только
+	 * записи, заголовок или содержимое которых изменились (а также
+	 * следующие за ними записи с тем же путь_именем).
+	 * @param files путь_имена входных файлов
+	 * @param nfiles количество файлов
+	 * @return код завершения программы
+	 */
+	int watch_run(char **files, int nfiles);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__watch_h__*/
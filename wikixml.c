@@ -0,0 +1,337 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include "wikixml.h"
+
+/** Размер буфера чтения XML. */
+#define WIKIXML_BUFSIZE      (64 * 1024)
+
+/** Максимальная длина заголовка статьи. */
+#define WIKIXML_MAX_TITLE    (512)
+
+/** Максимальная длина имени тега, которое нужно различать. */
+#define WIKIXML_MAX_TAG      (16)
+
+/** Максимальная длина сущности (без '&' и ';'). */
+#define WIKIXML_MAX_ENTITY   (16)
+
+/** Заголовок текущей статьи. */
+static char title[ WIKIXML_MAX_TITLE + 1 ];
+
+const char *wikixml_title() {
+	return title;
+}
+
+#ifdef _WIN32
+
+FILE *wikixml_open(FILE *xml) {
+	(void)xml;
+	errno = ENOSYS;
+	return NULL;
+}
+
+#else /* _WIN32 */
+
+/** Состояния разбора. */
+enum wikixml_state {
+	S_OUT,       /* вне интересующих элементов */
+	S_TAG,       /* имя тега */
+	S_SKIP,      /* остаток тега */
+	S_TEXTATTR,  /* атрибуты тега <text> */
+	S_TITLE,     /* содержимое <title> */
+	S_TEXT,      /* содержимое <text> */
+	S_ENTITY     /* сущность внутри <title> или <text> */
+};
+
+/** Состояние потока. */
+struct wikixml {
+	FILE *xml;
+
+	char buf[ WIKIXML_BUFSIZE ];
+	size_t pos;
+	size_t len;
+
+	enum wikixml_state state;
+	/* состояние, в которое возвращаемся после сущности */
+	enum wikixml_state ret;
+	/* состояние после завершения тега */
+	enum wikixml_state next;
+
+	char tag[ WIKIXML_MAX_TAG + 1 ];
+	size_t tag_len;
+	char prev;
+
+	char entity[ WIKIXML_MAX_ENTITY + 1 ];
+	size_t entity_len;
+
+	/* новый заголовок (до закрытия </title>) */
+	char title[ WIKIXML_MAX_TITLE + 1 ];
+	size_t title_len;
+
+	/* выход, не поместившийся в буфер читающего */
+	char pend[ WIKIXML_MAX_ENTITY + 2 ];
+	size_t pend_len;
+	size_t pend_pos;
+
+	/* последний выданный символ текста */
+	char last;
+};
+
+/** Текущий выходной буфер. */
+struct sink {
+	char *buf;
+	size_t size;
+	size_t done;
+};
+
+/**
+ * Процедура вывода символа текста статьи.
+ */
+static void emit(struct wikixml *x, struct sink *s, char c) {
+	if( s->done < s->size )
+		s->buf[ s->done++ ] = c;
+	else
+		x->pend[ x->pend_len++ ] = c;
+	x->last = c;
+}
+
+/**
+ * Процедура вывода символа (текста или заголовка).
+ */
+static void put(struct wikixml *x, struct sink *s, enum wikixml_state where, char c) {
+	if( S_TEXT == where )
+		emit(x, s, c);
+	else if( x->title_len < WIKIXML_MAX_TITLE )
+		x->title[ x->title_len++ ] = c;
+}
+
+/**
+ * Процедура раскодирования сущности.
+ * Неизвестная сущность выводится как есть.
+ */
+static void put_entity(struct wikixml *x, struct sink *s) {
+	static const struct { const char *name; char c; } named[] = {
+		{ "lt", '<' }, { "gt", '>' }, { "amp", '&' }, { "quot", '"' }, { "apos", '\'' }
+	};
+	const char *e = x->entity;
+	unsigned long u;
+	char *end;
+	size_t i;
+
+	x->entity[ x->entity_len ] = '\0';
+
+	for(i = 0; i < sizeof(named) / sizeof(named[0]); ++i) {
+		if( 0 == strcmp(e, named[i].name) ) {
+			put(x, s, x->ret, named[i].c);
+			return;
+		}
+	}
+
+	if( '#' == e[0] ) {
+		errno = 0;
+		if( 'x' == e[1] || 'X' == e[1] )
+			u = strtoul(e + 2, &end, 16);
+		else
+			u = strtoul(e + 1, &end, 10);
+
+		if( 0 == errno && '\0' == *end && end != e + 1 && u <= 0x10ffff ) {
+			/* UTF-8 */
+			if( u < 0x80 ) {
+				put(x, s, x->ret, (char)u);
+			} else if( u < 0x800 ) {
+				put(x, s, x->ret, (char)(0xc0 | (u >> 6)));
+				put(x, s, x->ret, (char)(0x80 | (u & 0x3f)));
+			} else if( u < 0x10000 ) {
+				put(x, s, x->ret, (char)(0xe0 | (u >> 12)));
+				put(x, s, x->ret, (char)(0x80 | ((u >> 6) & 0x3f)));
+				put(x, s, x->ret, (char)(0x80 | (u & 0x3f)));
+			} else {
+				put(x, s, x->ret, (char)(0xf0 | (u >> 18)));
+				put(x, s, x->ret, (char)(0x80 | ((u >> 12) & 0x3f)));
+				put(x, s, x->ret, (char)(0x80 | ((u >> 6) & 0x3f)));
+				put(x, s, x->ret, (char)(0x80 | (u & 0x3f)));
+			}
+			return;
+		}
+	}
+
+	put(x, s, x->ret, '&');
+	for(i = 0; i < x->entity_len; ++i)
+		put(x, s, x->ret, e[i]);
+	put(x, s, x->ret, ';');
+}
+
+/**
+ * Функция чтения текстов статей (интерфейс fopencookie).
+ * Чтение завершается на границе статьи.
+ */
+static ssize_t wikixml_read(void *cookie, char *buf, size_t size) {
+	struct wikixml *x = (struct wikixml*)cookie;
+	struct sink s;
+
+	s.buf = buf;
+	s.size = size;
+	s.done = 0;
+
+	/* остаток предыдущего чтения */
+	while( x->pend_pos < x->pend_len && s.done < s.size )
+		s.buf[ s.done++ ] = x->pend[ x->pend_pos++ ];
+	if( x->pend_pos == x->pend_len )
+		x->pend_pos = x->pend_len = 0;
+
+	while( s.done < s.size && 0 == x->pend_len ) {
+		char c;
+
+		if( x->pos == x->len ) {
+			x->pos = 0;
+			x->len = fread(x->buf, 1, sizeof(x->buf), x->xml);
+			if( 0 == x->len ) {
+				if( ferror(x->xml) && 0 == s.done )
+					return -1;
+				break;
+			}
+		}
+
+		c = x->buf[ x->pos++ ];
+
+		switch( x->state ) {
+		case S_OUT:
+			if( '<' == c ) {
+				x->tag_len = 0;
+				x->state = S_TAG;
+			}
+			break;
+
+		case S_TAG:
+			if( ' ' == c || '\t' == c || '\n' == c || '\r' == c || '>' == c || ('/' == c && 0 != x->tag_len) ) {
+				x->tag[ x->tag_len ] = '\0';
+				x->prev = c;
+				x->next = S_OUT;
+
+				if( 0 == strcmp(x->tag, "title") ) {
+					x->title_len = 0;
+					x->next = S_TITLE;
+				} else if( 0 == strcmp(x->tag, "/title") ) {
+					memcpy(title, x->title, x->title_len);
+					title[ x->title_len ] = '\0';
+				} else if( 0 == strcmp(x->tag, "page") ) {
+					title[0] = '\0';
+				} else if( 0 == strcmp(x->tag, "text") ) {
+					x->next = S_TEXT;
+				}
+
+				if( '>' == c )
+					x->state = x->next;
+				else if( S_TEXT == x->next )
+					x->state = S_TEXTATTR;
+				else
+					x->state = S_SKIP;
+
+			} else if( x->tag_len < WIKIXML_MAX_TAG ) {
+				x->tag[ x->tag_len++ ] = c;
+			} else {
+				x->next = S_OUT;
+				x->state = S_SKIP;
+			}
+			break;
+
+		case S_SKIP:
+			if( '>' == c )
+				x->state = x->next;
+			break;
+
+		case S_TEXTATTR:
+			if( '>' == c )
+				x->state = ('/' == x->prev) ? S_OUT : S_TEXT;
+			x->prev = c;
+			break;
+
+		case S_TITLE:
+		case S_TEXT:
+			if( '&' == c ) {
+				x->ret = x->state;
+				x->entity_len = 0;
+				x->state = S_ENTITY;
+
+			} else if( '<' == c ) {
+				x->tag_len = 0;
+
+				if( S_TEXT == x->state ) {
+					x->state = S_TAG;
+					/* текст статьи завершается переводом строки и границей чтения */
+					if( '\n' != x->last )
+						emit(x, &s, '\n');
+					if( 0 != s.done )
+						return s.done;
+					break;
+				}
+				x->state = S_TAG;
+
+			} else
+				put(x, &s, x->state, c);
+			break;
+
+		case S_ENTITY:
+			if( ';' == c ) {
+				put_entity(x, &s);
+				x->state = x->ret;
+			} else if( x->entity_len < WIKIXML_MAX_ENTITY ) {
+				x->entity[ x->entity_len++ ] = c;
+			} else {
+				/* слишком длинная: это не сущность */
+				size_t i;
+
+				put(x, &s, x->ret, '&');
+				for(i = 0; i < x->entity_len; ++i)
+					put(x, &s, x->ret, x->entity[i]);
+				--x->pos;
+				x->state = x->ret;
+			}
+			break;
+		}
+	}
+
+	return s.done;
+}
+
+/**
+ * Функция закрытия потока (интерфейс fopencookie).
+ */
+static int wikixml_close(void *cookie) {
+	struct wikixml *x = (struct wikixml*)cookie;
+	int rc = fclose(x->xml);
+
+	free(x);
+	title[0] = '\0';
+	return rc;
+}
+
+FILE *wikixml_open(FILE *xml) {
+	static const cookie_io_functions_t io = { wikixml_read, NULL, NULL, wikixml_close };
+	struct wikixml *x;
+	FILE *f;
+
+	if( NULL == (x = (struct wikixml*)calloc(1, sizeof(*x))) )
+		return NULL;
+
+	x->xml = xml;
+	x->state = S_OUT;
+	x->last = '\n';
+	title[0] = '\0';
+
+	if( NULL == (f = fopencookie(x, "rb", io)) ) {
+		free(x);
+		return NULL;
+	}
+
+	return f;
+}
+
+#endif /* _WIN32 */
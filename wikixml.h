@@ -0,0 +1,35 @@
+#ifndef __wikixml_h__
+#define __wikixml_h__
+
+#ifdef __cplusplus
+#include <cstdio>
+#else
+#include <stdio.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	/**
+	 * Функция открытия потока текстов статей из XML-выгрузки MediaWiki.
+	 * Поток содержит раскодированное содержимое элементов <text>; текст
+	 * каждой статьи завершается переводом строки. Разбор выполняется за
+	 * один проход в буфере фиксированного размера.
+	 * @param xml поток XML-выгрузки (закрывается вместе с результатом)
+	 * @return поток текстов статей; NULL -- ошибка
+	 */
+	FILE *wikixml_open(FILE *xml);
+
+	/**
+	 * Функция получения заголовка статьи, текст которой выдаётся потоком.
+	 * Данные одного чтения никогда не принадлежат двум статьям, поэтому
+	 * заголовок соответствует последней прочитанной из потока строке.
+	 * @return заголовок статьи; пустая строка -- заголовок неизвестен
+	 */
+	const char *wikixml_title();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__wikixml_h__*/